@@ -65,27 +65,49 @@ struct t_info {
 
 /* thread states ************************************************************/
 
-#define THREAD_COUNT 1024
-
-#define TS_FREE    0 // not currently an allocated thread
-#define TS_QUEUED  1 // in a scheduler queue
-#define TS_RUNNING 2 // currently running on a processor
-#define TS_WAITING 3 // waiting for an event
-#define TS_PAUSED  4 // paused due to pause() or a fault
-#define TS_PAUSEDW 5 // paused while waiting
+#define TS_FREE     0 // not currently an allocated thread
+#define TS_QUEUED   1 // in a scheduler queue
+#define TS_RUNNING  2 // currently running on a processor
+#define TS_WAITING  3 // waiting for an event
+#define TS_PAUSED   4 // paused due to pause() or a fault
+#define TS_PAUSEDW  5 // paused while waiting
+#define TS_STOPPING 6 // paused, but still running until its processor stops it
 
 #define TF_DEAD    1 // thread has exited or been killed
 #define TF_USER    2 // thread is in usermode
 
+#define SP_MIN   (-16) // lowest thread priority
+#define SP_MAX     15  // highest thread priority
+#define SP_COUNT   32  // number of thread priority levels
+
+#define SF_FIFO    1 // thread is only preempted by higher priority threads
+#define SF_FIXED   2 // thread is in the fixed-priority class, not the fair class
+#define SF_DEADLINE 4 // thread is in the deadline class (set by setdl only)
+#define SF_HANDOFF 8 // an IRQ waking this thread switches straight to it
+
 #define TE_STATE   1 // invalid state transition
 #define TE_EXIST   2 // thread does not exist
 #define TE_RESRC   3 // insufficient resources to fulfill request
+#define TE_PARAM   4 // invalid parameters
+#define TE_AGAIN   5 // value changed before the thread could block
 
 /* kernel calls *************************************************************/
 
 #define KCALL_KINFO    0x00 // int kinfo(struct k_info *info);
 #define KCALL_KCONFIG  0x01 // int kconfig(struct k_info *info);
 
+// Thread and paging context IDs are allocated from tables that grow as 
+// needed, up to the limits reported here.
+
+struct k_info {
+	uint32_t thread_limit; // maximum number of threads
+	uint32_t thread_count; // number of allocated threads
+	uint32_t pctx_limit;   // maximum number of paging contexts
+	uint32_t pctx_count;   // number of allocated paging contexts
+	uint32_t cpu_count;    // number of processors
+	uint32_t event_count;  // number of event vectors
+} __attribute__ ((packed));
+
 /* threading calls **********************************************************/
 
 #define KCALL_SPAWN    0x02 // int spawn(void *stack, void *entry)
@@ -98,10 +120,241 @@ struct t_info {
 #define KCALL_GETFAULT 0x09 // int getfault(void)
 #define KCALL_GETDEAD  0x0A // int getdead(void)
 #define KCALL_REAP     0x0B // int reap(int thread, struct t_info *info)
-#define KCALL_WAIT     0x0D // int wait(int event)
+#define KCALL_YIELDTO  0x0C // int yieldto(int thread)
+#define KCALL_WAIT     0x0D // int wait(int event, uint64_t timeout_ns)
 #define KCALL_RESET    0x0E // int reset(int event)
 #define KCALL_SYSRET   0x0F // (used from assembly only)
 
+/* sleep and time calls *****************************************************/
+
+// wait() returns -1 if its timeout (if nonzero) expires before the event
+
+#define KCALL_SLEEP      0x2C // int sleep(uint64_t ns)
+#define KCALL_SLEEPUNTIL 0x2D // int sleepuntil(uint64_t ns_since_boot)
+#define KCALL_GETTIME    0x2E // int gettime(uint64_t *ns_since_boot)
+
+/* kernel data page *********************************************************/
+
+// Each processor has a page of kernel-maintained data, readable from every
+// privilege level through the segment in GS (always KDATA_SEL). Reading a 
+// field is a single "mov reg, [gs:offset]", which cannot be split by a 
+// migration to another processor, so fields like the thread ID are always 
+// consistent with the reader.
+
+#define KDATA_SEL 0x43
+
+struct k_data {
+	int32_t  thread;   // ID of the thread running on this processor
+	int32_t  cpu;      // logical processor number
+	uint32_t epoch;    // incremented every time this processor loads a thread
+	uint32_t ticks;    // timer interrupts taken by this processor
+	uint64_t clock;    // clock time (1/2^20 s) of the last timer interrupt
+	uint64_t tsc_base; // TSC value at clock time zero
+	uint32_t tsc_mult; // clock ticks per TSC cycle (0.32 fixed point)
+	uint32_t flags;    // KDATA_F_* flags
+} __attribute__((packed));
+
+// clock = ((tsc - tsc_base) * tsc_mult) >> 32
+// ns    = (clock * 1000000000) >> 20
+
+#define KDATA_THREAD   0
+#define KDATA_CPU      4
+#define KDATA_EPOCH    8
+#define KDATA_TICKS    12
+#define KDATA_CLOCK    16
+#define KDATA_TSC_BASE 24
+#define KDATA_TSC_MULT 32
+#define KDATA_FLAGS    36
+
+#define KDATA_F_SYSENTER 0x1 // kcalls may be made with SYSENTER (see below)
+#define KDATA_F_GATE     0x2 // the syscall gate has an entry point
+
+// SYSENTER kcalls take the same registers as "int 0x81", plus the return
+// address in edi and the stack pointer to return with in ebp. They return
+// with "iret" like any other kcall, and may be restarted by the kernel at 
+// eip - 2, so the return address must follow an "int 0x81" instruction.
+
+/* syscall gate calls *******************************************************/
+
+// Usermode enters the system layer directly with "call GATE_SEL:0", which 
+// lands at the entry point registered with setgate() on the stack the 
+// thread had when it last made the SYSRET kcall, with the far return frame
+// (eip, cs, esp, ss) on top of it. The system layer returns with "retf".
+// Without a registered entry point, usermode uses "int 0x81" as before, 
+// which the kernel reflects to the system layer.
+
+#define GATE_SEL 0x4B
+
+#define KCALL_SETGATE 0x30 // int setgate(void *entry)
+
+/* thread-local storage calls ***********************************************/
+
+// Every thread runs with TLS_SEL in FS, a flat data segment whose base is 
+// the thread's TLS base (zero unless set), so thread-local data is one 
+// "mov reg, [fs:offset]" away at every privilege level. A thread's new base
+// takes effect when settls returns, if it set its own, or else the next time
+// the thread is switched in.
+
+#define TLS_SEL 0x53
+
+#define KCALL_SETTLS 0x32 // int settls(int thread, uintptr_t base)
+#define KCALL_GETTLS 0x33 // uintptr_t gettls(int thread)
+
+/* wait set calls ***********************************************************/
+
+// waitset() blocks until one of the selected sources fires, then returns 
+// the source in eax: an event number (0-255) with its interrupt count (see
+// irqmode() below) in ebx, KWAIT_SRC_DEAD with the dead thread's ID in ebx,
+// KWAIT_SRC_FAULT with the faulted thread's ID in ebx, or KWAIT_SRC_NONE if
+// the timeout (if nonzero) expired or the set is empty.
+// Threads waiting on a single source are served before any wait set.
+
+#define KCALL_WAITSET 0x34 // int waitset(struct k_waitset *set, uint64_t timeout_ns)
+
+struct k_waitset {
+	uint32_t events[8]; // bitmap of events (bit n of word n / 32 is event n)
+	uint32_t flags;     // KWAIT_* flags
+} __attribute__((packed));
+
+#define KWAIT_DEAD  0x1 // also wait for a dead thread (as with getdead())
+#define KWAIT_FAULT 0x2 // also wait for a faulted thread (as with getfault())
+
+#define KWAIT_SRC_NONE  (-1)
+#define KWAIT_SRC_DEAD  256
+#define KWAIT_SRC_FAULT 257
+
+/* IRQ delivery calls *******************************************************/
+
+// An IRQ is one-shot by default: the kernel masks the line when it fires, 
+// and it stays pending (wait() returns at once) until the driver calls 
+// reset(). A counting IRQ (KIRQ_COUNT) stays unmasked; every interrupt adds
+// to its pending count, and wait() returns the count, clearing it, once it 
+// reaches the threshold, or whatever count is pending (else -1) when the 
+// timeout expires. reset() is not needed, but discards the count. Counting 
+// is refused (TE_PARAM) for level-triggered lines, which would not stop.
+
+#define KCALL_IRQMODE 0x35 // int irqmode(int irq, int flags, int threshold)
+
+#define KIRQ_COUNT 0x1 // count interrupts instead of masking the line
+
+/* event delivery calls *****************************************************/
+
+// Each time an event fires, it wakes one waiter by default. evmode() sets 
+// the number of waiters it wakes instead, or KEV_WAKE_ALL to wake them all
+// (e.g. every thread waiting on an EV_VTIMER vector on each tick). Threads 
+// waiting on the event alone are woken first, in order, then wait sets. A 
+// counting IRQ's count is delivered to every thread it wakes.
+
+#define KCALL_EVMODE 0x36 // int evmode(int event, int wake)
+
+#define KEV_WAKE_ALL (-1)
+
+/* event ring calls *********************************************************/
+
+// A thread can have the events it selects delivered as records into a ring
+// in its own memory instead of waking it one kcall at a time. evring() 
+// takes a writable, page-aligned page for the ring (or NULL to stop) and a
+// wait set of events (flags are ignored); each event can be routed to only
+// one ring. The kernel appends a record at tail for every event (for a 
+// counting IRQ, every time it reaches its threshold), or counts it in lost
+// if the ring is full, and the thread consumes records from head. One-shot
+// IRQs are still masked when they fire: the thread resets them by setting 
+// their bits in ack, which the kernel picks up the next time it touches the
+// ring. evrwait() blocks only while the ring is empty, and returns the 
+// number of records available (zero if the timeout expires first).
+
+#define KCALL_EVRING  0x37 // int evring(struct k_evring *ring, struct k_waitset *set)
+#define KCALL_EVRWAIT 0x38 // int evrwait(uint64_t timeout_ns)
+
+#define KEVRING_SIZE 128 // records in a ring
+
+struct k_evrec {
+	uint32_t event; // event vector
+	uint32_t count; // interrupt count (see irqmode() above), or one
+	uint64_t clock; // clock time (see k_data) when the event was recorded
+};
+
+struct k_evring {
+	uint32_t head;   // next record the thread reads (thread advances)
+	uint32_t tail;   // next free record slot (kernel advances)
+	uint32_t mask;   // KEVRING_SIZE - 1
+	uint32_t lost;   // records dropped because the ring was full
+	uint32_t ack[8]; // bitmap of IRQs to reset (thread sets, kernel clears)
+	uint32_t reserved[4];
+	struct k_evrec rec[KEVRING_SIZE];
+};
+
+/* kcall ring ***************************************************************/
+
+// A thread can queue kcalls in the submission ring of a struct k_ring and
+// have them run in order by a single batch() kcall, which posts a completion
+// for each one (in the same order) and returns how many it ran. It stops 
+// early if the completion ring fills up. Only kcalls that never block or 
+// switch out the caller can be queued (so not setstate(), and not freepctx()
+// of the caller's own paging context); others complete with a result of -1.
+
+#define KCALL_BATCH 0x31 // int batch(struct k_ring *ring)
+
+#define KSQE_PREV 0x1 // use the previous entry's result as arg1
+
+struct k_sqe {
+	uint32_t call;  // kcall number
+	uint32_t arg0;  // (ebx)
+	uint32_t arg1;  // (ecx)
+	uint32_t arg2;  // (edx)
+	uint32_t flags; // KSQE_* flags
+	uint32_t data;  // copied to the completion
+};
+
+struct k_cqe {
+	uint32_t data;    // from the submission
+	uint32_t result;  // (eax)
+	uint32_t result2; // (ebx) high half of 64-bit results
+};
+
+struct k_ring {
+	uint32_t sq_head; // next submission the kernel runs (kernel advances)
+	uint32_t sq_tail; // next free submission slot (thread advances)
+	uint32_t cq_head; // next completion the thread reads (thread advances)
+	uint32_t cq_tail; // next free completion slot (kernel advances)
+	uint32_t mask;    // size of both rings minus one (size is a power of 2)
+	struct k_sqe *sq;
+	struct k_cqe *cq;
+};
+
+/* wait-on-address calls ****************************************************/
+
+#define KCALL_FUTEXWAIT 0x28 // int futexwait(uint32_t *addr, uint32_t value)
+#define KCALL_FUTEXWAKE 0x29 // int futexwake(uint32_t *addr, int count)
+
+/* resource usage calls *****************************************************/
+
+#define KCALL_GETUSAGE  0x24 // int getusage(int thread, struct t_usage *usage)
+#define KCALL_PCTXUSAGE 0x25 // int pctxusage(int pctx, struct t_usage *usage)
+
+struct t_usage {
+	uint64_t run_cycles;    // TSC cycles spent running the thread itself
+	uint64_t kernel_cycles; // TSC cycles spent in the kernel on its behalf
+	uint32_t vswitches;     // voluntary context switches (yield, wait, etc.)
+	uint32_t iswitches;     // involuntary context switches (preemption)
+	uint32_t faults;        // faults taken
+	uint32_t kcalls;        // kernel calls issued
+} __attribute__((packed));
+
+/* deadline scheduling calls ************************************************/
+
+#define KCALL_SETDL    0x20 // int setdl(int thread, struct t_dl *dl)
+#define KCALL_GETDL    0x21 // int getdl(int thread, struct t_dl *dl)
+
+struct t_dl {
+	uint32_t period;   // period in microseconds (0 to leave deadline class)
+	uint32_t budget;   // processor time per period in microseconds
+	uint32_t deadline; // relative deadline in microseconds (0 for period)
+	uint32_t misses;   // number of missed deadlines and budget overruns
+} __attribute__((packed));
+
+#define DL_PERIOD_MAX 1000000 // longest allowed period in microseconds
+
 #define FV_PAGE 1 // page fault
 #define FV_ACCS 2 // access violation (other than page fault)
 
@@ -123,14 +376,38 @@ struct t_info {
 #define KCALL_GETFRAME 0x14 // uint64_t getframe(uintptr_t page)
 #define KCALL_GETFLAGS 0x15 // int getflags(uintptr_t page)
 
+// Range calls change many pages with a single TLB invalidation at the end.
+// UNMAP frees the frames of the present pages it removes; PROTECT changes
+// the flags of present pages only.
+
+#define KCALL_MAPV    0x16 // int mapv(struct k_mapping *map, int count)
+#define KCALL_UNMAP   0x17 // int unmap(uintptr_t base, int count)
+#define KCALL_PROTECT 0x18 // int protect(uintptr_t base, int count, int flags)
+
+struct k_mapping {
+	uint32_t vaddr;
+	uint32_t frame;
+	uint32_t flags;
+} __attribute__ ((packed));
+
+// ALLOC backs the pages of a range that are not present with fresh frames,
+// and FREE unmaps a range and frees its frames (like UNMAP). Both return the
+// number of pages affected, or -1. Besides page flags, <flags> may request
+// zeroed pages and name the paging context to work in (by default, the 
+// current one).
+
+#define KCALL_ALLOC 0x19 // int alloc(uintptr_t base, int count, int flags)
+#define KCALL_FREE  0x1A // int free(uintptr_t base, int count, int flags)
+
+#define KMEM_ZERO      0x1000 // zero the allocated pages
+#define KMEM_PCTX(n)   (((n) + 1) << 16) // work in paging context <n>
+
 #define KCALL_NEWFRAME  0x1C // uint64_t newframe(void);
 #define KCALL_FREEFRAME 0x1D // int freeframe(uint64_t frame);
 #define KCALL_TAKEFRAME 0x1E // int takeframe(uint64_t frame);
 
 /* memory management constants and macros ***********************************/
 
-#define PCTX_COUNT 1024
-
 #define PFLAG_PRES  0x001
 #define PFLAG_WRITE 0x002
 #define PFLAG_USER	0x004
@@ -73,10 +73,13 @@ align 4096
 	dd 0x0000FFFF, 0x00CFFA00
 	dd 0x0000FFFF, 0x00CFF200
 	dd 0x00000000, 0x0000E900 ; This will become the TSS
+	dd 0x00000FFF, 0x0040F200 ; This will become the kernel data page
+	dd 0x00190000, 0x00006C00 ; This will become the syscall gate
+	dd 0x0000FFFF, 0x00CFF200 ; This will become the thread TLS segment
 
 gdt_ptr:
 align 4
-	dw 0x003F	; 47 bytes limit
+	dw 0x0057	; 88 bytes limit
 	dd gdt 		; Points to *virtual* GDT
 
 section .text
@@ -23,11 +23,20 @@
 /* general CPU operations ***************************************************/
 
 void cpu_set_stack(void *ptr);
-void cpu_idle(void);
+void cpu_idle(void *stack);
 void cpu_halt(void);
 
 /* floating point unit operations *******************************************/
 
+#define FPU_NONE     0 // no FPU
+#define FPU_FXSAVE   1 // legacy FXSAVE area (512 bytes)
+#define FPU_XSAVE    2 // XSAVE area (fpu_size bytes, 64-byte aligned)
+#define FPU_XSAVEOPT 3 // ...saving only state modified since XRSTOR
+#define FPU_XSAVEC   4 // ...saving only state in use, compacted
+
+extern uint32_t fpu_mode;
+extern uint32_t fpu_size;
+
 void fpu_save(void *fxdata);
 void fpu_load(void *fxdata);
 void cpu_init_fpu(void);
@@ -46,7 +55,13 @@ uint32_t cpu_get_cr2   (void);
 uint32_t cpu_get_cr3   (void);
 uint32_t cpu_get_eflags(void);
 uint32_t cpu_get_id    (uint32_t selector);
-uint32_t cpu_get_tsc   (void);
+uint64_t cpu_get_tsc   (void);
+
+void cpu_set_msr(uint32_t msr, uint64_t value);
+
+#define MSR_SYSENTER_CS  0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
 
 void cpu_set_ts(void);
 void cpu_clr_ts(void);
@@ -59,13 +74,16 @@ struct tss {
 	uint32_t prev_tss;
 	uint32_t esp0;
 	uint32_t ss0;
-	uint32_t unused[15];
+	uint32_t esp1;
+	uint32_t ss1;
+	uint32_t unused[13];
 	uint32_t es, cs, ss, ds, fs, gs;
 	uint32_t ldt;
 	uint16_t trap, iomap_base;
 } __attribute__ ((packed));
 
 void cpu_sync_tss(void);
+void cpu_set_gdt(void *gdt);
 
 struct idt {
 	uint16_t base_l;
@@ -14,10 +14,6 @@
 
 [bits 32]
 
-section .bss
-
-idle_stack: resb 0x1000
-
 section .data
 
 idt_ptr:
@@ -31,6 +27,20 @@ cpu_clr_ts:
 	clts
 	ret
 
+global cpu_set_ts
+cpu_set_ts:
+	mov eax, cr0
+	or eax, 0x8
+	mov cr0, eax
+	ret
+
+global cpu_tst_ts
+cpu_tst_ts:
+	mov eax, cr0
+	shr eax, 3
+	and eax, 1
+	ret
+
 global cpu_flush_tlb_full
 cpu_flush_tlb_full:
 	mov eax, cr3
@@ -68,6 +78,14 @@ cpu_get_id:
 	pop ebx
 	ret
 
+global cpu_set_msr
+cpu_set_msr:
+	mov ecx, [esp+4]
+	mov eax, [esp+8]
+	mov edx, [esp+12]
+	wrmsr
+	ret
+
 global cpu_get_tsc
 cpu_get_tsc:
 	rdtsc
@@ -80,7 +98,7 @@ cpu_halt:
 
 global cpu_idle
 cpu_idle:
-	mov esp, idle_stack + 0xFF0
+	mov esp, [esp+4]
 .ab:
 	sti
 	hlt
@@ -111,6 +129,25 @@ cpu_set_stack:
 	push ecx
 	ret
 
+global cpu_set_gdt
+cpu_set_gdt:
+	mov eax, [esp+4]
+	sub esp, 8
+	mov word [esp], 0x57
+	mov [esp+2], eax
+	lgdt [esp]
+	add esp, 8
+
+	mov ax, 0x10
+	mov ds, ax
+	mov es, ax
+	mov fs, ax
+	mov gs, ax
+	mov ss, ax
+	jmp 0x08:.reload
+.reload:
+	ret
+
 global cpu_sync_tss
 cpu_sync_tss:
 	mov ax, 0x38
@@ -40,6 +40,7 @@ void fault_generic(struct thread *image) {
 	thread_save(image);
 	image->state = TS_PAUSED;
 	image->fault = FV_ACCS;
+	image->usage.faults++;
 
 	// add to fault queue
 	fault_push(image);
@@ -78,11 +79,24 @@ void fault_page(struct thread *image) {
 	image->fault_addr = cr2;
 	image->fault = FV_PAGE;
 	image->state = TS_PAUSED;
+	image->usage.faults++;
 
 	// add to fault queue
 	fault_push(image);
 }
 
+/*****************************************************************************
+ * fault_nm
+ *
+ * Device not available handler. The kernel never uses the FPU, so this is a
+ * thread using the FPU for the first time since it was switched in; it gets
+ * the FPU, with its own state loaded if necessary, and retries.
+ */
+
+void fault_nm(struct thread *image) {
+	fpu_take(image);
+}
+
 /*****************************************************************************
  * fault_double
  *
@@ -42,6 +42,7 @@
 
 void fault_generic(struct thread *image);
 void fault_page   (struct thread *image);
+void fault_nm     (struct thread *image);
 void fault_double (struct thread *image);
 
 #endif/*KERNEL_FAULT_H*/
@@ -14,13 +14,28 @@
 
 [bits 32]
 
+; save mechanisms, best last (see fpu_mode in "cpu.h")
+%define FPU_NONE     0
+%define FPU_FXSAVE   1
+%define FPU_XSAVE    2
+%define FPU_XSAVEOPT 3
+%define FPU_XSAVEC   4
+
 section .data
 
 global can_use_fpu
+global fpu_mode
+global fpu_size
 
 can_use_fpu: 
 	dd 0
 
+fpu_mode:
+	dd FPU_NONE
+
+fpu_size:
+	dd 512
+
 section .text
 
 global cpu_init_fpu
@@ -29,9 +44,11 @@ global fpu_load
 
 cpu_init_fpu:
 	push ebx
+	push edi
 
 	mov eax, 1
 	mov [can_use_fpu], eax
+	mov dword [fpu_mode], FPU_FXSAVE
 
 	; initialize FPU
 	finit
@@ -45,24 +62,97 @@ cpu_init_fpu:
 	or eax,  0x00000600 ; set OSFXR, OSXMMEXCPT
 	mov cr4, eax
 
-.nofpu:
+	; check for XSAVE
+	mov eax, 1
+	cpuid
+	test ecx, 0x04000000
+	jz .done
+	mov edi, ecx
+
+	; initialize XSAVE, with x87, SSE, and AVX state if supported
+	mov eax, cr4
+	or eax,  0x00040000 ; set OSXSAVE
+	mov cr4, eax
+
+	mov eax, 0x3
+	test edi, 0x10000000
+	jz .noavx
+	or eax, 0x4
+.noavx:
+	xor edx, edx
+	xor ecx, ecx
+	xsetbv
+
+	; get size of save area for the enabled state
+	mov eax, 0xD
+	xor ecx, ecx
+	cpuid
+	mov [fpu_size], ebx
+	mov dword [fpu_mode], FPU_XSAVE
+
+	; check for XSAVEC (compacted) and XSAVEOPT (modified only)
+	mov eax, 0xD
+	mov ecx, 1
+	cpuid
+	test eax, 0x2
+	jz .noxsavec
+	mov dword [fpu_mode], FPU_XSAVEC
+	jmp .done
+.noxsavec:
+	test eax, 0x1
+	jz .done
+	mov dword [fpu_mode], FPU_XSAVEOPT
+
+.done:
+	pop edi
 	pop ebx
 	ret
 
+; the XSAVE family saves all state enabled in XCR0 (the mask in edx:eax is 
+; all ones); XRSTOR handles both the standard and compacted formats
+
 fpu_save:
-	mov eax, [can_use_fpu]
-	cmp eax, 0
-	je .blank
 	mov ecx, [esp+4]
-	fsave [ecx]
+	mov eax, [fpu_mode]
+	cmp eax, FPU_XSAVEC
+	je .xsavec
+	cmp eax, FPU_XSAVEOPT
+	je .xsaveopt
+	cmp eax, FPU_XSAVE
+	je .xsave
+	cmp eax, FPU_FXSAVE
+	jne .blank
+	fxsave [ecx]
 .blank:
 	ret
+.xsave:
+	mov eax, 0xFFFFFFFF
+	mov edx, 0xFFFFFFFF
+	xsave [ecx]
+	ret
+.xsaveopt:
+	mov eax, 0xFFFFFFFF
+	mov edx, 0xFFFFFFFF
+	xsaveopt [ecx]
+	ret
+.xsavec:
+	mov eax, 0xFFFFFFFF
+	mov edx, 0xFFFFFFFF
+	xsavec [ecx]
+	ret
 
 fpu_load:
-	mov eax, [can_use_fpu]
-	cmp eax, 0
-	je .blank
 	mov ecx, [esp+4]
-	frstor [ecx]
+	mov eax, [fpu_mode]
+	cmp eax, FPU_XSAVE
+	jae .xrstor
+	cmp eax, FPU_FXSAVE
+	jne .blank
+	fxrstor [ecx]
 .blank:
 	ret
+.xrstor:
+	mov eax, 0xFFFFFFFF
+	mov edx, 0xFFFFFFFF
+	xrstor [ecx]
+	ret
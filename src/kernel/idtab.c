@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2012 Nick Johnson <nickbjohnson4224 at gmail.com>
+ * 
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include <config/address.h>
+#include <stdint.h>
+
+#include "space.h"
+#include "idtab.h"
+
+#define IDTAB_FREE(next) ((((uintptr_t) (next) + 1) << 1) | 1)
+#define IDTAB_NEXT(slot) ((int) ((slot) >> 1) - 1)
+
+/****************************************************************************
+ * idtab_grow
+ *
+ * Adds a leaf to the given table, putting all of its IDs on the free list. 
+ * Returns zero on success, nonzero if the table is full or out of memory.
+ */
+
+static int idtab_grow(struct idtab *table) {
+	uintptr_t *leaf;
+	int base;
+
+	if (table->leaves >= IDTAB_LEAVES) {
+		return 1;
+	}
+
+	leaf = heap_alloc(IDTAB_LEAF * sizeof(uintptr_t));
+	if (!leaf) {
+		return 1;
+	}
+
+	base = table->leaves * IDTAB_LEAF;
+
+	for (int i = IDTAB_LEAF - 1; i >= 0; i--) {
+		leaf[i] = IDTAB_FREE(table->free);
+		table->free = base + i;
+	}
+
+	table->leaf[table->leaves++] = leaf;
+
+	return 0;
+}
+
+/****************************************************************************
+ * idtab_alloc
+ *
+ * Allocates an ID in the given table for <value>, which must be nonzero and
+ * even. Returns the ID, or -1 if no ID could be allocated.
+ */
+
+int idtab_alloc(struct idtab *table, uintptr_t value) {
+	uintptr_t *slot;
+	int id;
+
+	if (table->free < 0 && idtab_grow(table)) {
+		return -1;
+	}
+
+	id = table->free;
+	slot = &table->leaf[id / IDTAB_LEAF][id % IDTAB_LEAF];
+
+	table->free = IDTAB_NEXT(*slot);
+	table->count++;
+	*slot = value;
+
+	return id;
+}
+
+/****************************************************************************
+ * idtab_free
+ *
+ * Frees an allocated ID in the given table.
+ */
+
+void idtab_free(struct idtab *table, int id) {
+	uintptr_t *slot;
+
+	if (!idtab_get(table, id)) {
+		return;
+	}
+
+	slot = &table->leaf[id / IDTAB_LEAF][id % IDTAB_LEAF];
+
+	*slot = IDTAB_FREE(table->free);
+	table->free = id;
+	table->count--;
+}
+
+/****************************************************************************
+ * idtab_get
+ *
+ * Returns the value associated with an ID in the given table, or zero if 
+ * the ID is not allocated.
+ */
+
+uintptr_t idtab_get(struct idtab *table, int id) {
+	uintptr_t slot;
+
+	if (id < 0 || id >= table->leaves * IDTAB_LEAF) {
+		return 0;
+	}
+
+	slot = table->leaf[id / IDTAB_LEAF][id % IDTAB_LEAF];
+
+	return (slot & 1) ? 0 : slot;
+}
+
+/****************************************************************************
+ * idtab_limit
+ *
+ * Returns one more than the highest ID that could currently be allocated in
+ * the given table, for iterating over it.
+ */
+
+int idtab_limit(struct idtab *table) {
+	return table->leaves * IDTAB_LEAF;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2012 Nick Johnson <nickbjohnson4224 at gmail.com>
+ * 
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef KERNEL_IDTAB_H
+#define KERNEL_IDTAB_H
+
+#include <stdint.h>
+
+/*****************************************************************************
+ * ID tables
+ *
+ * Growable two-level tables mapping small integer IDs to nonzero, even 
+ * values (kernel pointers or frame addresses). Leaves of IDTAB_LEAF slots 
+ * are allocated as IDs are needed, up to IDTAB_MAX IDs. Free slots form a 
+ * list threaded through the slots themselves (tagged with the low bit), so
+ * allocating and freeing an ID is O(1), and the lowest IDs of each new leaf
+ * are handed out first.
+ */
+
+#define IDTAB_LEAF   1024 // slots per leaf (one page)
+#define IDTAB_LEAVES 64   // maximum number of leaves
+#define IDTAB_MAX    (IDTAB_LEAF * IDTAB_LEAVES)
+
+struct idtab {
+	uintptr_t *leaf[IDTAB_LEAVES];
+	int leaves; // number of leaves allocated
+	int count;  // number of IDs allocated
+	int free;   // first free ID, or -1
+};
+
+#define IDTAB_INIT { { 0 }, 0, 0, -1 }
+
+int       idtab_alloc(struct idtab *table, uintptr_t value);
+void      idtab_free (struct idtab *table, int id);
+uintptr_t idtab_get  (struct idtab *table, int id);
+int       idtab_limit(struct idtab *table);
+
+#endif/*KERNEL_IDTAB_H*/
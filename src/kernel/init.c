@@ -23,6 +23,7 @@
 #include "fault.h"
 #include "space.h"
 #include "debug.h"
+#include "smp.h"
 #include "cpu.h"
 #include "elf.h"
 
@@ -168,7 +169,7 @@ struct thread *init(struct multiboot *mboot, uint32_t mboot_magic) {
 	int_set_handler(FAULT_OF, fault_generic);
 	int_set_handler(FAULT_BR, fault_generic);
 	int_set_handler(FAULT_UD, fault_generic);
-	int_set_handler(FAULT_NM, fault_generic);
+	int_set_handler(FAULT_NM, fault_nm);
 	int_set_handler(FAULT_DF, fault_double);
 	int_set_handler(FAULT_CO, fault_generic);
 	int_set_handler(FAULT_TS, fault_generic);
@@ -181,16 +182,22 @@ struct thread *init(struct multiboot *mboot, uint32_t mboot_magic) {
 	int_set_handler(FAULT_MC, fault_generic);
 	int_set_handler(FAULT_XM, fault_generic);
 
-	/* start timer (for preemption) */
-	timer_set_freq(64);
+	/* start tickless timer (for preemption) */
+	timer_set_tickless(64);
 
 	/* initialize FPU/MMX/SSE */
 	cpu_init_fpu();
 
+	/* start other processors (held idle by the kernel lock until we return) */
+	smp_lock();
+	smp_init();
+
 	/* drop to usermode, scheduling the next thread */
 	debug_printf("passing control to system\n");
 
 	thread_load(init_thread);
 	init_thread->state = TS_RUNNING;
+
+	smp_unlock();
 	return init_thread;
 }
@@ -70,6 +70,12 @@ INTN	47
 
 INTN    129 ; kcall
 
+; local APIC
+INTN	240 ; timer
+INTN	241 ; wakeup IPI
+INTN	242 ; TLB shootdown IPI
+INTN	255 ; spurious
+
 extern int_handler
 extern fpu_save
 extern fpu_load
@@ -91,20 +97,92 @@ int_common:
 
 	mov ebp, esp
 
-	; Setup stack
-	extern kstack
- 
-	mov esp, (kstack + 0x1FF0)
+	; Setup stack (per-CPU, indexed by local APIC ID)
+	extern cpu_kstack
+	extern lapic_id
+
+	mov eax, [lapic_id]
+	mov eax, [eax]
+	shr eax, 24
+	mov esp, [cpu_kstack + eax * 4]
+
+	push ebp
+	call int_handler
+	mov esp, eax
+	jmp int_return
+
+; SYSENTER kcall entry
+;
+; IA32_SYSENTER_ESP points at the "thread" field of this processor's struct 
+; cpu, so the active thread's interrupt frame can be built in place, exactly
+; as "int 0x81" would have left it (with the caller's return address from 
+; edi and stack pointer from ebp). SYSENTER does not save the caller's CS,
+; but usermode cannot load the system data segment, so a caller without it
+; in DS is given a usermode frame. The caller's segment registers are flat, 
+; so they are not reloaded for the kernel, and are only restored on return 
+; if the kernel switched threads or changed them.
+
+global sysenter_entry
+sysenter_entry:
+	mov esp, [esp]
+	add esp, 64 ; &thread->vm86_es (top of the interrupt frame)
+
+	push 0x21   ; ss
+	push ebp    ; useresp
+	pushf
+	or dword [esp], 0x200 ; eflags (SYSENTER cleared IF)
+	push 0x19   ; cs
+	push edi    ; eip
+	push 0      ; err
+	push 0x81   ; num
+
+	pusha
+
+	xor eax, eax
+	mov ax, ds
+	push eax
+
+	cmp eax, 0x21
+	je .system
+	mov dword [esp + 48], 0x2B ; cs
+	mov dword [esp + 60], 0x33 ; ss
+.system:
+
+	mov ebp, esp
+
+	mov eax, [lapic_id]
+	mov eax, [eax]
+	shr eax, 24
+	mov esp, [cpu_kstack + eax * 4]
 
 	push ebp
 	call int_handler
 	mov esp, eax
 
+	; switched threads, or changed segments: take the full path
+	cmp eax, ebp
+	jne int_return
+	xor ecx, ecx
+	mov cx, ds
+	cmp [esp], ecx
+	jne int_return
+
+	; the TLS segment base may have been changed
+	mov cx, 0x53 ; TLS_SEL
+	mov fs, cx
+
+	add esp, 4
+	popa
+	add esp, 8
+	iret
+
 int_return:
 	pop eax
 	mov ds, ax
 	mov es, ax
+	mov ax, 0x53 ; TLS_SEL
 	mov fs, ax
+	mov ax, 0x43 ; KDATA_SEL
 	mov gs, ax
 
 	popa
@@ -14,10 +14,14 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <config/address.h>
+
 #include "interrupt.h"
 #include "string.h"
+#include "space.h"
 #include "ports.h"
 #include "debug.h"
+#include "smp.h"
 #include "cpu.h"
 
 /*****************************************************************************
@@ -29,7 +33,10 @@
 
 static int _is_init;
 static void init_idt(void);
-static void init_tss(void);
+static void init_tss(struct cpu *cpu);
+static void init_kdata(struct cpu *cpu);
+static void init_sysenter(struct cpu *cpu);
+static void init_tls(struct cpu *cpu);
 
 /* interrupt handling *******************************************************/
 
@@ -58,6 +65,28 @@ void int_set_handler(intid_t n, int_handler_t handler) {
 	_int_handler[n] = handler;
 }
 
+/*****************************************************************************
+ * _int_handoff
+ *
+ * Thread to be run next in place of the scheduler's choice, set by 
+ * int_handoff() from within an interrupt handler and consumed by 
+ * int_handler() before it returns.
+ */
+
+static struct thread *_int_handoff;
+
+/*****************************************************************************
+ * int_handoff
+ *
+ * Called from an interrupt handler that has just descheduled the active 
+ * thread: makes int_handler() switch directly to the given queued thread, 
+ * without consulting the scheduler or checking it for preemption.
+ */
+
+void int_handoff(struct thread *thread) {
+	_int_handoff = thread;
+}
+
 /*****************************************************************************
  * int_handler
  *
@@ -67,31 +96,100 @@ void int_set_handler(intid_t n, int_handler_t handler) {
  */
 
 struct thread *int_handler(struct thread *image) {
+	struct thread *caller;
+	uint64_t entry, exit;
+	int stopped = 0;
+
+	/* enter the kernel (only one processor may be in it at a time) */
+	smp_lock();
+
+	caller = thread_get_active();
+	entry  = cpu_get_tsc();
+
+	/* charge time since the last return to the interrupted thread */
+	if (caller) {
+		caller->usage.run_cycles += entry - caller->usage_stamp;
+	}
+
+	/* switch out the interrupted thread if another processor paused it */
+	if (caller && caller->state != TS_RUNNING) {
+		thread_save(caller);
+		stopped = 1;
+
+		if (caller->state == TS_STOPPING) {
+			caller->state = TS_PAUSED;
+		}
+
+		if (caller->pauser) {
+			caller->pauser->state = TS_QUEUED;
+			schedule_push(caller->pauser);
+			caller->pauser = NULL;
+		}
+
+		/* restart its kcall (int 0x81) when it is resumed */
+		if (image->num == 0x81) {
+			image->eip -= 2;
+		}
+	}
 
 	/* reset IRQs if it was an IRQ */
 	if (ISIRQ(image->num)) {
 
 		if (INT2IRQ(image->num) != 0) {
+			struct thread *handler = event_front(INT2IRQ(image->num));
+
 			event_send(-1, INT2IRQ(image->num));
+
+			/* switch straight to the woken driver thread if it asks for it */
+			if (handler && handler->state == TS_QUEUED && !_int_handoff
+					&& schedule_handoff(thread_get_active(), handler)) {
+				if (thread_get_active()) {
+					thread_preempt_front(thread_get_active());
+				}
+				int_handoff(handler);
+			}
 		}
 		else {
 			irq_reset(INT2IRQ(image->num));
 		}
 	}
 
-	/* call registered interrupt handler */
-	if (_int_handler[image->num]) {
+	/* call registered interrupt handler (faults and kcalls of a stopped thread
+	 * are not handled: they happen again when it is resumed) */
+	if (stopped && (image->num < IRQ_INT_BASE || image->num == 0x81)) {
+		/* skip */
+	}
+	else if (_int_handler[image->num]) {
 		_int_handler[image->num](image);
 	}
 
-	/* return active thread */
+	/* preempt active thread if a higher priority thread is now queued */
 	image = thread_get_active();
+	if (image && schedule_preempt(image)) {
+		thread_preempt(image);
+		image = NULL;
+	}
+
+	/* return active thread */
 	if (!image) {
 
-		/* get next thread from scheduler */
-		image = schedule_next();
-		if (!image) {
-			cpu_idle();
+		if (_int_handoff) {
+
+			/* switch directly to the thread that was handed off to */
+			image = _int_handoff;
+			_int_handoff = NULL;
+		}
+		else {
+
+			/* get next thread from scheduler */
+			image = schedule_next();
+			if (!image) {
+				if (caller) {
+					caller->usage.kernel_cycles += cpu_get_tsc() - entry;
+				}
+				timer_update();
+				smp_idle();
+			}
 		}
 
 		/* schedule new active thread */
@@ -100,6 +198,18 @@ struct thread *int_handler(struct thread *image) {
 		image->state = TS_RUNNING;
 	}
 
+	/* reprogram timer for the next timeslice or virtual timer */
+	timer_update();
+
+	/* charge time spent in the kernel to the interrupted thread */
+	exit = cpu_get_tsc();
+	if (caller) {
+		caller->usage.kernel_cycles += exit - entry;
+	}
+	image->usage_stamp = exit;
+
+	smp_unlock();
+
 	return image;
 }
 
@@ -130,7 +240,9 @@ extern void
 	int40(void), int41(void), int42(void), int43(void), 
 	int44(void), int45(void), int46(void), int47(void),
 
-	int129(void);
+	int129(void),
+
+	int240(void), int241(void), int242(void), int255(void);
 
 /*****************************************************************************
  * idt_raw
@@ -193,65 +305,67 @@ static void init_idt(void) {
 		}
 	}
 
+	/* Write local APIC interrupt handlers (timer, IPIs) */
+	idt_set(LAPIC_VECTOR_TIMER,    (uint32_t) int240, 0x08, 0x8E);
+	idt_set(LAPIC_VECTOR_WAKE,     (uint32_t) int241, 0x08, 0x8E);
+	idt_set(LAPIC_VECTOR_FLUSH,    (uint32_t) int242, 0x08, 0x8E);
+	idt_set(LAPIC_VECTOR_SPURIOUS, (uint32_t) int255, 0x08, 0x8E);
+
 	/* Write usermode interrupt handlers (syscalls) */
 	idt_set(129, (uint32_t) int129, 0x08, 0xEE);
 
-	/* Write the IDT */
-	cpu_set_idt(idt);
-
-	/* setup the TSS */
-	init_tss();
+	/* Write the IDT and setup the TSS */
+	int_init_cpu(cpu_get());
 }
 
-/* TSS driver ***************************************************************/
-
 /*****************************************************************************
- * tss
+ * int_init_cpu
  *
- * The "Task State Segment" also known as the TSS. This is part of the x86
- * architecture that can be used for hardware task switching, but we're only
- * using it to set the interrupt handler stack.
+ * Load the IDT and set up the TSS on the current processor. The BSP does
+ * this when the interrupt system is initialized; each AP does it when it
+ * starts.
  */
 
-static struct tss tss;
-
-/*****************************************************************************
- * gdt
- *
- * The "Global Descriptor Table" also known as the GDT. This is the part of 
- * the x86 architecture that contains all of the protected mode segment 
- * descriptors. Each descriptor is actually 8 bytes in length, but we're
- * interpreting it as an array of bytes for simplicity. The TSS is the sixth
- * descriptor.
- *
- * The actual gdt is defined in "kernel/boot.s".
- */
+void int_init_cpu(struct cpu *cpu) {
+	cpu_set_idt(idt);
+	init_tss(cpu);
+	init_kdata(cpu);
+	init_sysenter(cpu);
+	init_tls(cpu);
+}
 
-extern uint8_t gdt[64];
+/* TSS driver ***************************************************************/
 
 /*****************************************************************************
  * init_tss
  *
- * Initializes the system responsible for set_int_stack(). On the x86, this
- * effectively means initializing the TSS, which is responsible for usermode
- * to kernelmode switches.
+ * Initializes the system responsible for set_int_stack() on the current
+ * processor. On the x86, this effectively means initializing the TSS, which 
+ * is responsible for usermode to kernelmode switches. Each processor has its
+ * own TSS and its own GDT (the "Global Descriptor Table", which contains all
+ * of the protected mode segment descriptors) to point to it. The BSP's GDT 
+ * is defined in "kernel/boot.s"; APs use a copy of it.
  */
 
-static void init_tss(void) {
-	uint32_t base = (uint32_t) &tss;
+static void init_tss(struct cpu *cpu) {
+	struct tss *tss = &cpu->tss;
+	uint8_t *gdt = cpu->gdt;
+	uint32_t base = (uint32_t) tss;
 	uint16_t limit = (uint16_t) (base + sizeof(struct tss) - 1);
 
-	memclr(&tss, sizeof(struct tss));
-	tss.cs = 0x08;
-	tss.ss0 = tss.es = tss.ds = tss.fs = tss.gs = 0x10;
-	tss.iomap_base = 104;
+	memclr(tss, sizeof(struct tss));
+	tss->cs = 0x08;
+	tss->ss0 = tss->es = tss->ds = tss->fs = tss->gs = 0x10;
+	tss->ss1 = 0x21;
+	tss->iomap_base = 104;
 
-	/* Change the 8th GDT entry to be the TSS */
+	/* Change the 8th GDT entry to be the (available) TSS */
 	gdt[56] = (uint8_t) ((limit) & 0xFF);
 	gdt[57] = (uint8_t) ((limit >> 8) & 0xFF);
 	gdt[58] = (uint8_t) (base & 0xFF);
 	gdt[59] = (uint8_t) ((base >> 8) & 0xFF);
 	gdt[60] = (uint8_t) ((base >> 16) & 0xFF);
+	gdt[61] = 0xE9;
 	gdt[63] = (uint8_t) ((base >> 24) & 0xFF);
 
 	cpu_sync_tss();
@@ -267,7 +381,39 @@ static void init_tss(void) {
  */
 
 void set_int_stack(void *ptr) {
-	tss.esp0 = (uintptr_t) ptr;
+	cpu_get()->tss.esp0 = (uintptr_t) ptr;
+}
+
+/*****************************************************************************
+ * set_gate_stack
+ *
+ * Sets the system layer stack pointer used when usermode enters the system
+ * layer through the syscall gate. It should always be set to the running 
+ * thread's saved system stack pointer (thread->sys_esp).
+ */
+
+void set_gate_stack(uint32_t esp) {
+	cpu_get()->tss.esp1 = esp;
+}
+
+/*****************************************************************************
+ * set_tls_base
+ *
+ * Sets the base of the thread TLS segment (the 11th GDT entry, TLS_SEL) on 
+ * the current processor. It should always be set to the running thread's 
+ * TLS base (thread->tls_base); int_return reloads FS to pick it up.
+ */
+
+void set_tls_base(uint32_t base) {
+	struct cpu *cpu = cpu_get();
+
+	if (cpu->tls_base != base) {
+		cpu->gdt[82] = (uint8_t) (base & 0xFF);
+		cpu->gdt[83] = (uint8_t) ((base >> 8) & 0xFF);
+		cpu->gdt[84] = (uint8_t) ((base >> 16) & 0xFF);
+		cpu->gdt[87] = (uint8_t) ((base >> 24) & 0xFF);
+		cpu->tls_base = base;
+	}
 }
 
 /* 8259 PIC driver **********************************************************/
@@ -315,6 +461,25 @@ int irq_unmask(irqid_t irq) {
 	return 0;
 }
 
+/*****************************************************************************
+ * irq_level
+ *
+ * Returns nonzero if <irq> is level-triggered, according to the chipset's 
+ * edge/level control registers (ELCR). IRQs 0, 1, 2, 8 and 13 are always 
+ * edge-triggered; if any of them reads as level-triggered, there is no ELCR
+ * and every IRQ is edge-triggered, as the PIC was initialized.
+ */
+
+int irq_level(irqid_t irq) {
+	uint16_t elcr = inb(0x4D0) | (inb(0x4D1) << 8);
+
+	if (elcr & 0x2107) {
+		return 0;
+	}
+
+	return (elcr >> irq) & 1;
+}
+
 /*****************************************************************************
  * irq_reset
  *
@@ -344,38 +509,276 @@ int irq_reset(irqid_t irq) {
 
 /* 8253 PIT driver **********************************************************/
 
-static uint32_t pit_freq = 1;
+#define PIT_HZ 1193182 // PIT input clock frequency
+#define PIT_CALIBRATE 11932 // PIT cycles to calibrate the TSC over (10 ms)
+#define PIT_MAX_SHOT 57000 // longest one-shot interval (in clock ticks)
 
 /*****************************************************************************
- * timer_handler (interrupt handler)
+ * tsc_base, tsc_mult
  *
- * Increments the timer tick and preempts the current thread.
+ * The timer clock is derived from the TSC: timer_clock() is the number of
+ * TSC cycles since tsc_base, times tsc_mult, which is the number of clock
+ * ticks per TSC cycle as a 0.32 fixed point number. Both are set by
+ * timer_calibrate().
  */
 
-static void timer_handler(struct thread *image) {
-	static uint32_t tick = 0;
+static uint64_t tsc_base;
+static uint32_t tsc_mult;
+
+/*****************************************************************************
+ * timer_quantum
+ *
+ * The length of a timeslice in clock ticks if the timer is in tickless
+ * (one-shot) mode, or zero if the timer is periodic.
+ */
 
-	tick++;
+static uint32_t timer_quantum;
 
-	// trigger virtual event timers
-	uint32_t ptime = ((tick - 1) << 10) / pit_freq;
-	uint32_t ctime = (tick << 10) / pit_freq;
-	uint32_t time = (ptime ^ ctime);
-	time = time + (time & -time) - 1;
+/*****************************************************************************
+ * timer_shot, timer_slice, timer_owner, timer_last
+ *
+ * Tickless mode state: the clock time the one-shot timer is programmed to
+ * fire at (zero if the timer is stopped), the clock time the timeslice of
+ * timer_owner ends at (zero if it is the only runnable thread), and the
+ * clock time of the last timer interrupt.
+ */
 
+static uint64_t timer_shot;
+static uint64_t timer_slice;
+static struct thread *timer_owner;
+static uint64_t timer_last;
+
+/*****************************************************************************
+ * timer_clock
+ *
+ * Returns the time since the timer was initialized, in units of 1/TIMER_HZ
+ * seconds.
+ */
+
+uint64_t timer_clock(void) {
+	uint64_t delta = cpu_get_tsc() - tsc_base;
+
+	return (delta >> 32) * tsc_mult + (((delta & 0xFFFFFFFF) * tsc_mult) >> 32);
+}
+
+/*****************************************************************************
+ * timer_calibrate
+ *
+ * Measures the TSC frequency against PIT channel 2 and initializes the timer
+ * clock from it.
+ */
+
+static void timer_calibrate(void) {
+	uint64_t start, cycles;
+
+	/* enable channel 2 gate, disable speaker */
+	outb(0x61, (inb(0x61) & ~0x02) | 0x01);
+
+	/* channel 2, mode 0 (interrupt on terminal count) */
+	outb(0x43, 0xB0);
+	outb(0x42, (uint8_t) (PIT_CALIBRATE & 0xFF));
+	outb(0x42, (uint8_t) (PIT_CALIBRATE >> 8));
+
+	/* wait for channel 2 output to go high */
+	start = cpu_get_tsc();
+	while (!(inb(0x61) & 0x20));
+	cycles = cpu_get_tsc() - start;
+
+	/* clock ticks per TSC cycle = (PIT_CALIBRATE * TIMER_HZ / PIT_HZ) / cycles */
+	tsc_mult = ((((uint64_t) PIT_CALIBRATE << 40) / PIT_HZ) << 12) / cycles;
+	tsc_base = start;
+
+	if (cpu_get()->kdata) {
+		cpu_get()->kdata->tsc_base = tsc_base;
+		cpu_get()->kdata->tsc_mult = tsc_mult;
+	}
+}
+
+/*****************************************************************************
+ * pit_oneshot
+ *
+ * Programs PIT channel 0 to fire once after <ticks> clock ticks, or stops it
+ * if <ticks> is zero.
+ */
+
+static void pit_oneshot(uint32_t ticks) {
+	uint32_t count;
+
+	/* channel 0, mode 0 (interrupt on terminal count) */
+	outb(0x43, 0x30);
+
+	if (!ticks) {
+		/* counter stays stopped until a count is written */
+		return;
+	}
+
+	count = (((uint64_t) ticks * PIT_HZ) >> 20) + 1;
+	if (count > 0xFFFF) count = 0xFFFF;
+
+	outb(0x40, (uint8_t) (count & 0xFF));
+	outb(0x40, (uint8_t) (count >> 8));
+}
+
+/*****************************************************************************
+ * timer_update
+ *
+ * In tickless mode, reprograms the timer to fire at the next point where it
+ * is needed: the end of the active thread's timeslice if another thread is
+ * queued, the next point the deadline scheduler needs to act, the next
+ * timer wheel expiry, or the next period of any virtual timer that has a 
+ * waiting thread. If none of these exist, the timer is stopped. This is 
+ * called every time the kernel returns from an interrupt, but only touches 
+ * the PIT if the next expiry time changed.
+ */
+
+void timer_update(void) {
+	struct thread *active;
+	uint64_t now, next, dl;
+
+	if (!timer_quantum || cpu_get()->id) {
+		/* periodic mode, or an AP (which uses its local APIC timer) */
+		return;
+	}
+
+	now = timer_clock();
+	next = 0;
+
+	/* timeslice expiry, if there is competition for the processor */
+	active = thread_get_active();
+	if (active && schedule_next()) {
+		if (active != timer_owner || !timer_slice) {
+			timer_owner = active;
+			timer_slice = now + timer_quantum;
+		}
+		next = timer_slice;
+	}
+	else {
+		timer_slice = 0;
+	}
+
+	/* deadline budget exhaustion and replenishment */
+	dl = schedule_timer(active);
+	if (dl && (!next || dl < next)) next = dl;
+
+	/* sleep and timeout expiry */
+	dl = wheel_next();
+	if (dl && (!next || dl < next)) next = dl;
+
+	/* virtual timer expiry */
 	for (int i = 0; i < 16; i++) {
-		if (time & (1 << (15 - i))) {
+		if (event_waiting(EV_VTIMER(i))) {
+			uint64_t period = ((now >> (25 - i)) + 1) << (25 - i);
+			if (!next || period < next) next = period;
+		}
+	}
+
+	if (next == timer_shot) {
+		return;
+	}
+	timer_shot = next;
+
+	if (!next) {
+		pit_oneshot(0);
+	}
+	else if (next <= now) {
+		pit_oneshot(1);
+	}
+	else if (next - now > PIT_MAX_SHOT) {
+		pit_oneshot(PIT_MAX_SHOT);
+	}
+	else {
+		pit_oneshot(next - now);
+	}
+}
+
+/*****************************************************************************
+ * timer_donate
+ *
+ * Give the remainder of <from>'s timeslice to <to>, which is about to be run
+ * in its place. Has no effect in periodic mode, or if <from> does not own the
+ * current timeslice.
+ */
+
+void timer_donate(struct thread *from, struct thread *to) {
+
+	if (timer_slice && timer_owner == from) {
+		timer_owner = to;
+	}
+}
+
+/*****************************************************************************
+ * timer_handler (interrupt handler)
+ *
+ * Triggers virtual timers, expires sleeps and timeouts on the timer wheel,
+ * runs the deadline scheduler, increments the timer tick and preempts the 
+ * current thread if its timeslice or deadline budget is over.
+ */
+
+static void timer_handler(struct thread *image) {
+	struct thread *active = thread_get_active();
+	uint64_t now = timer_clock();
+
+	// trigger virtual event timers whose period boundary has passed
+	for (int i = 0; i < 16; i++) {
+		if ((timer_last >> (25 - i)) != (now >> (25 - i))) {
 			event_send(-1, EV_VTIMER(i));
 		}
 	}
+	timer_last = now;
+
+	cpu_get()->kdata->ticks++;
+	cpu_get()->kdata->clock = now;
+
+	// wake threads whose sleep or timeout is over
+	wheel_run(now);
+
+	// replenish deadline budgets and enforce budget exhaustion
+	if (schedule_clock(active, now) && active->state == TS_RUNNING) {
+		thread_preempt(active);
+		return;
+	}
+
+	if (timer_quantum) {
+		
+		// one-shot timer has fired
+		timer_shot = 0;
+
+		// only preempt at the end of a timeslice
+		if (!timer_slice || now < timer_slice) {
+			return;
+		}
+		timer_slice = 0;
+	}
+
+	if (!active) {
+		return;
+	}
+
+	active->tick++;
+
+	if (active->state == TS_RUNNING && schedule_tick(active)) {
+		thread_preempt(active);
+	}
+}
+
+/*****************************************************************************
+ * timer_init
+ *
+ * Calibrates the timer clock and registers the timer interrupt handler.
+ */
 
-	image->tick++;
+static void timer_init(void) {
+	static int is_init;
 
-	if (image->state == TS_RUNNING) {
-		thread_save(image);
-		schedule_push(image);
-		image->state = TS_QUEUED;
+	if (is_init) {
+		return;
 	}
+	is_init = 1;
+
+	timer_calibrate();
+
+	irq_init();
+	int_set_handler(IRQ2INT(0), timer_handler);
 }
 
 /******************************************************************************
@@ -389,20 +792,181 @@ static void timer_handler(struct thread *image) {
 int timer_set_freq(uint32_t hertz) {
 	uint32_t divider;
 
-	divider = 1193180 / hertz;
+	divider = PIT_HZ / hertz;
 
 	if ((divider == 0) || (divider >= 65536)) {
 		return 1;
 	}
 
+	timer_init();
+
 	outb(0x43, 0x36);
 	outb(0x40, (uint8_t) (divider & 0xFF));
 	outb(0x40, (uint8_t) (divider >> 0x8));
 
-	irq_init();
-	int_set_handler(IRQ2INT(0), timer_handler);
+	timer_quantum = 0;
 
-	pit_freq = hertz;
+	return 0;
+}
+
+/******************************************************************************
+ * timer_set_tickless
+ *
+ * Puts the timer in tickless mode with a timeslice of 1/<hertz> seconds. In
+ * this mode, the timer is reprogrammed in one-shot mode to fire only when a 
+ * timeslice ends or a virtual timer with waiting threads expires, and is 
+ * stopped entirely when neither is pending. If the timer has not been 
+ * initialized, it is done now. Returns zero on success, nonzero on failure.
+ */
+
+int timer_set_tickless(uint32_t hertz) {
+
+	if (hertz == 0 || hertz > TIMER_HZ) {
+		return 1;
+	}
+
+	timer_init();
+
+	timer_quantum = TIMER_HZ / hertz;
+
+	/* force the PIT out of whatever mode it was in */
+	timer_shot = 1;
+	timer_update();
 
 	return 0;
 }
+
+/* kernel data page *********************************************************/
+
+/*****************************************************************************
+ * init_kdata
+ *
+ * Allocates and maps the kernel data page (struct k_data) of the current
+ * processor, and points the 9th GDT entry at it. The page is mapped twice: 
+ * read-only and user-accessible at CPU_KDATA_ADDR + id * PAGESZ, which the 
+ * GDT entry (KDATA_SEL) covers, and writable for the kernel at 
+ * CPU_KDATA_KADDR + id * PAGESZ. int_return loads KDATA_SEL into GS for
+ * every thread.
+ */
+
+static void init_kdata(struct cpu *cpu) {
+	uint8_t *gdt = cpu->gdt;
+	uint32_t base  = CPU_KDATA_ADDR  + cpu->id * PAGESZ;
+	uint32_t kbase = CPU_KDATA_KADDR + cpu->id * PAGESZ;
+	frame_t frame;
+
+	if (!cpu->kdata) {
+		frame = frame_new();
+		page_set(base,  page_fmt(frame, PF_PRES | PF_USER));
+		page_set(kbase, page_fmt(frame, PF_PRES | PF_RW));
+
+		cpu->kdata = (void*) kbase;
+		memclr(cpu->kdata, PAGESZ);
+	}
+
+	cpu->kdata->thread   = -1;
+	cpu->kdata->cpu      = cpu->id;
+	cpu->kdata->tsc_base = tsc_base;
+	cpu->kdata->tsc_mult = tsc_mult;
+
+	/* the syscall gate may have been set up in the GDT this one copied */
+	if (gdt[77] & 0x80) {
+		cpu->kdata->flags |= KDATA_F_GATE;
+	}
+
+	/* Change the 9th GDT entry to be the (ring 3) kernel data segment */
+	gdt[64] = 0xFF;
+	gdt[65] = 0x0F;
+	gdt[66] = (uint8_t) (base & 0xFF);
+	gdt[67] = (uint8_t) ((base >> 8) & 0xFF);
+	gdt[68] = (uint8_t) ((base >> 16) & 0xFF);
+	gdt[69] = 0xF2;
+	gdt[70] = 0x40;
+	gdt[71] = (uint8_t) ((base >> 24) & 0xFF);
+}
+
+/* SYSENTER kcall entry *****************************************************/
+
+/*****************************************************************************
+ * init_sysenter
+ *
+ * If the processor supports SYSENTER, sets it up to enter the kernel at 
+ * sysenter_entry (in "kernel/int.s") and advertises it to the system layer 
+ * in the kernel data page. SYSEXIT is not used to return, because it can
+ * only return to ring 3, and kcalls come from the system layer in ring 1.
+ */
+
+static void init_sysenter(struct cpu *cpu) {
+	extern void sysenter_entry(void);
+
+	/* CPUID.1:EDX.SEP */
+	if (!(cpu_get_id(1) & (1 << 11))) {
+		cpu->kdata->flags &= ~KDATA_F_SYSENTER;
+		return;
+	}
+
+	cpu_set_msr(MSR_SYSENTER_CS,  0x08);
+	cpu_set_msr(MSR_SYSENTER_ESP, (uintptr_t) &cpu->thread);
+	cpu_set_msr(MSR_SYSENTER_EIP, (uintptr_t) sysenter_entry);
+
+	cpu->kdata->flags |= KDATA_F_SYSENTER;
+}
+
+/* syscall gate *************************************************************/
+
+/*****************************************************************************
+ * gate_set_entry
+ *
+ * Points the syscall gate (the 10th GDT entry, a ring 3 call gate into the
+ * ring 1 system code segment) at <entry> on every processor, or disables it
+ * if <entry> is zero. Processors brought up later copy the BSP's GDT.
+ */
+
+void gate_set_entry(uint32_t entry) {
+
+	for (int i = 0; i < cpu_count; i++) {
+		struct cpu *cpu = cpu_lookup(i);
+		uint8_t *gdt = cpu->gdt;
+
+		gdt[72] = (uint8_t) (entry & 0xFF);
+		gdt[73] = (uint8_t) ((entry >> 8) & 0xFF);
+		gdt[74] = 0x19;
+		gdt[75] = 0x00;
+		gdt[76] = 0x00;
+		gdt[77] = (entry) ? 0xEC : 0x6C;
+		gdt[78] = (uint8_t) ((entry >> 16) & 0xFF);
+		gdt[79] = (uint8_t) ((entry >> 24) & 0xFF);
+
+		if (entry) {
+			cpu->kdata->flags |= KDATA_F_GATE;
+		}
+		else {
+			cpu->kdata->flags &= ~KDATA_F_GATE;
+		}
+	}
+}
+
+/* thread TLS segment *******************************************************/
+
+/*****************************************************************************
+ * init_tls
+ *
+ * Sets up the thread TLS segment (the 11th GDT entry) as a flat ring 3 data
+ * segment with base zero, which is what threads without a TLS base get. The
+ * GDT of an AP is copied from the BSP's, which may have another base in it.
+ */
+
+static void init_tls(struct cpu *cpu) {
+	uint8_t *gdt = cpu->gdt;
+
+	gdt[80] = 0xFF;
+	gdt[81] = 0xFF;
+	gdt[82] = 0x00;
+	gdt[83] = 0x00;
+	gdt[84] = 0x00;
+	gdt[85] = 0xF2;
+	gdt[86] = 0xCF;
+	gdt[87] = 0x00;
+
+	cpu->tls_base = 0;
+}
@@ -26,9 +26,24 @@
 typedef void (*int_handler_t) (struct thread *);
 void int_set_handler(intid_t n, int_handler_t handler);
 
+/* directed thread switch ***************************************************/
+
+void int_handoff(struct thread *thread);
+
+/* per-processor setup ******************************************************/
+
+struct cpu;
+void int_init_cpu(struct cpu *cpu);
+
 /* interrupt stack **********************************************************/
 
 void set_int_stack(void *ptr);
+void set_gate_stack(uint32_t esp);
+void set_tls_base(uint32_t base);
+
+/* syscall gate *************************************************************/
+
+void gate_set_entry(uint32_t entry);
 
 /* IRQ numbering macros *****************************************************/
 
@@ -51,9 +66,16 @@ int irq_reset(irqid_t irq);
 
 int irq_mask(irqid_t irq);
 int irq_unmask(irqid_t irq);
+int irq_level(irqid_t irq);
+
+/* timer ********************************************************************/
 
-/* timer frequency **********************************************************/
+#define TIMER_HZ 1048576 // frequency of timer_clock()
 
-int timer_set_freq(uint32_t hertz);
+int      timer_set_freq    (uint32_t hertz);
+int      timer_set_tickless(uint32_t hertz);
+void     timer_update      (void);
+uint64_t timer_clock       (void);
+void     timer_donate      (struct thread *from, struct thread *to);
 
 #endif/*KERNEL_INTERRUPT_H*/
@@ -14,22 +14,132 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <config/address.h>
 #include <pinion.h>
 
+#include "interrupt.h"
 #include "syscall.h"
 #include "string.h"
 #include "space.h"
 #include "thread.h"
 #include "debug.h"
 #include "pctx.h"
+#include "smp.h"
 
 static void save_info(struct t_info *dest, struct thread *src);
+
+/*****************************************************************************
+ * dl_us2clock, dl_clock2us
+ *
+ * Convert between microseconds (used by the deadline kcalls) and timer clock
+ * ticks (used by the scheduler). One microsecond is 1.048576 ticks.
+ */
+
+static uint32_t dl_us2clock(uint32_t us) {
+	return ((uint64_t) us * 68719) >> 16;
+}
+
+static uint32_t dl_clock2us(uint32_t clock) {
+	return (((uint64_t) clock << 16) + 68718) / 68719;
+}
+
+/*****************************************************************************
+ * time_ns2clock, time_clock2ns
+ *
+ * Convert between nanoseconds (used by the sleep and timeout kcalls) and 
+ * timer clock ticks, without overflowing for large times. Conversion to 
+ * clock ticks rounds up, so timeouts never expire early.
+ */
+
+static uint64_t time_ns2clock(uint64_t ns) {
+	return ((ns / 1000000000) << 20) 
+		+ (((ns % 1000000000) << 20) + 999999999) / 1000000000;
+}
+
+static uint64_t time_clock2ns(uint64_t clock) {
+	return (clock >> 20) * 1000000000 + (((clock & 0xFFFFF) * 1000000000) >> 20);
+}
+
+/*****************************************************************************
+ * kcall_batching, kcall_flush_pending
+ *
+ * While a batch of kcalls is being run by kcall_batch(), TLB shootdowns 
+ * requested by page operations are deferred and merged: kcall_flush_pending
+ * is the paging context that needs to be flushed on all processors (-1 for
+ * all contexts), or -2 if none does.
+ */
+
+static int kcall_batching;
+static int kcall_flush_pending = -2;
+
+static void kcall_flush(uint32_t page) {
+	int pctx = (page >= SYSTEM_ADDR_BASE) ? -1 : cpu_get()->pctx;
+
+	if (!kcall_batching) {
+		smp_flush_tlb(pctx);
+	}
+	else if (kcall_flush_pending == -2) {
+		kcall_flush_pending = pctx;
+	}
+	else if (kcall_flush_pending != pctx) {
+		kcall_flush_pending = -1;
+	}
+}
+
+static void kcall_flush_finish(void) {
+
+	if (kcall_flush_pending != -2) {
+		smp_flush_tlb(kcall_flush_pending);
+		kcall_flush_pending = -2;
+	}
+}
+
+/*****************************************************************************
+ * kcall_mem
+ *
+ * Runs an ALLOC or FREE kcall (base in ebx, page count in ecx, flags in edx),
+ * loading the paging context named in the flags for the duration if it is 
+ * not the current one. Returns the number of pages affected, or -1.
+ */
+
+static int kcall_mem(struct thread *image) {
+	uint32_t flags = image->edx;
+	int pctx = (int) (flags >> 16) - 1;
+	int old = cpu_get()->pctx;
+	uint32_t cr3 = 0;
+	int result;
+
+	if (pctx >= 0 && pctx != old && image->ebx < SYSTEM_ADDR_BASE) {
+		cr3 = pctx_enter(pctx);
+
+		if (!cr3) {
+			return -1;
+		}
+	}
+
+	if (image->eax == KCALL_ALLOC) {
+		result = mem_anon(image->ebx, image->ecx, flags & PF_MASK, flags & KMEM_ZERO);
+	}
+	else {
+		result = mem_unmap(image->ebx, image->ecx);
+	}
+
+	if (cr3) {
+		pctx_leave(old, cr3);
+	}
+
+	return result;
+}
+
+static void kcall_dispatch(struct thread *image);
+static void kcall_batch(struct thread *image);
+
 //static void load_info(struct thread *dest, struct t_info *src);
 
 void kcall(struct thread *image) {
 
-	if (image->flags & TF_USER) {
-		// perform syscall
+	if ((image->cs & 3) == 3) {
+		// perform syscall (for usermode without the syscall gate)
 
 		// save user state
 		image->usr_eip = image->eip;
@@ -48,8 +158,37 @@ void kcall(struct thread *image) {
 		return;
 	}
 
+	image->usage.kcalls++;
+
+	kcall_dispatch(image);
+}
+
+/*****************************************************************************
+ * kcall_dispatch
+ *
+ * Perform the kcall described by the registers of <image>, leaving its 
+ * results in them.
+ */
+
+static void kcall_dispatch(struct thread *image) {
+
 	switch (image->eax) {
 
+	case KCALL_KINFO: {
+
+		struct k_info *info = (void*) image->ebx;
+
+		info->thread_limit = thread_limit();
+		info->thread_count = thread_count();
+		info->pctx_limit   = pctx_limit();
+		info->pctx_count   = pctx_count();
+		info->cpu_count    = cpu_count;
+		info->event_count  = EV_COUNT;
+
+		image->eax = 0;
+		break;
+	}
+
 	case KCALL_SPAWN: {
 
 		int id = thread_new();
@@ -78,6 +217,10 @@ void kcall(struct thread *image) {
 		thread->ebx     = state->regs.ebx;
 		thread->eax     = state->regs.eax;
 
+		// inherit scheduling parameters (but not deadline reservations)
+		thread->sched_priority = image->sched_priority;
+		thread->sched_flags    = image->sched_flags & ~SF_DEADLINE;
+
 		// add to scheduler queue
 		thread->state = TS_QUEUED;
 		schedule_push(thread);
@@ -115,6 +258,7 @@ void kcall(struct thread *image) {
 
 	case KCALL_YIELD: {
 		
+		schedule_yield(image);
 		thread_save(image);
 		schedule_push(image);
 		image->state = TS_QUEUED;
@@ -122,6 +266,36 @@ void kcall(struct thread *image) {
 		break;
 	}
 
+	case KCALL_YIELDTO: {
+
+		struct thread *target = thread_get(image->ebx);
+
+		if (!target) {
+			image->eax = TE_EXIST;
+		}
+		else if (target == image) {
+			image->eax = 0;
+		}
+		else if (target->state != TS_QUEUED || schedule_throttled(target)) {
+			image->eax = TE_STATE;
+		}
+		else {
+
+			// give the rest of this timeslice to the target
+			timer_donate(image, target);
+			image->eax = 0;
+
+			thread_save(image);
+			schedule_push(image);
+			image->state = TS_QUEUED;
+
+			// switch to target without going through the scheduler
+			int_handoff(target);
+		}
+
+		break;
+	}
+
 	case KCALL_PAUSE: {
 
 		struct thread *target = thread_get(image->ebx);
@@ -133,6 +307,23 @@ void kcall(struct thread *image) {
 		else switch (target->state) {
 		case TS_RUNNING:
 
+			if (target != image) {
+
+				// pause (running on another processor): that processor
+				// switches it out (making it TS_PAUSED) and requeues this
+				// thread when it has
+				target->state = TS_STOPPING;
+				target->pauser = image;
+				
+				image->eax = 0;
+				thread_save(image);
+				image->state = TS_WAITING;
+				image->event = -1;
+
+				smp_kick(cpu_lookup(target->cpu));
+				break;
+			}
+
 			// pause (normal, from running)
 			thread_save(target);
 			target->state = TS_PAUSED;
@@ -151,7 +342,52 @@ void kcall(struct thread *image) {
 
 		case TS_WAITING:
 
-			// pause (waiting)
+			if (!waitset_remv(target)) {
+				wheel_remv(target);
+
+				// pause (wait set; returns with no source)
+				target->eax = KWAIT_SRC_NONE;
+				target->state = TS_PAUSED;
+
+				image->eax = 0;
+				break;
+			}
+
+			if (!evring_remv(target)) {
+				wheel_remv(target);
+
+				// pause (event ring; returns with no records)
+				target->eax = 0;
+				target->state = TS_PAUSED;
+
+				image->eax = 0;
+				break;
+			}
+
+			if (target->event == -1 && !wheel_remv(target)) {
+
+				// pause (sleeping; the sleep ends early)
+				target->eax = 0;
+				target->state = TS_PAUSED;
+
+				image->eax = 0;
+				break;
+			}
+
+			if (!futex_remv(target)) {
+
+				// pause (futex wait; appears as a spurious wakeup)
+				target->eax = 0;
+				target->state = TS_PAUSED;
+
+				image->eax = 0;
+				break;
+			}
+
+			// pause (waiting; any timeout is re-armed by resume)
+			if (!wheel_remv(target)) {
+				target->timer_paused = 1;
+			}
 			event_remv(target->id, target->event);
 			target->state = TS_PAUSEDW;
 
@@ -186,9 +422,16 @@ void kcall(struct thread *image) {
 
 		case TS_PAUSEDW:
 
-			// resume thread by entering wait queue
+			// resume thread by entering wait queue (or returning, if the
+			// event came in the meantime) with its remaining timeout
 			event_wait(target->id, target->event);
-			target->state = TS_WAITING;
+
+			if (target->timer_paused) {
+				target->timer_paused = 0;
+				if (target->state == TS_WAITING) {
+					wheel_add(target, target->timer_expiry);
+				}
+			}
 
 			image->eax = 0;
 			break;
@@ -229,6 +472,12 @@ void kcall(struct thread *image) {
 		if (!target) {
 			image->eax = TE_EXIST;
 		}
+		else if ((target->state == TS_RUNNING || target->state == TS_STOPPING) 
+				&& target != image) {
+
+			// running on another processor
+			image->eax = TE_STATE;
+		}
 		else switch (target->state) {
 		case TS_PAUSED:
 		case TS_PAUSEDW:
@@ -252,6 +501,7 @@ void kcall(struct thread *image) {
 
 				// change paging contexts
 				pctx_load(src->pctx);
+				thread_retire_usage(target);
 			}
 
 			// save thread state
@@ -259,6 +509,13 @@ void kcall(struct thread *image) {
 			target->flags = src->flags;
 			target->fault = src->fault;
 
+			// save scheduling parameters (deadline class is set by setdl)
+			target->sched_priority = src->sched_priority;
+			target->sched_flags    = (src->sched_flags & ~SF_DEADLINE) 
+				| (target->sched_flags & SF_DEADLINE);
+			if (target->sched_priority < SP_MIN) target->sched_priority = SP_MIN;
+			if (target->sched_priority > SP_MAX) target->sched_priority = SP_MAX;
+
 			if (target->state != TS_RUNNING) {
 
 				// save register state
@@ -274,8 +531,7 @@ void kcall(struct thread *image) {
 				target->eflags = src->regs.eflags;
 
 				// save MMX/SSE state
-				if (!target->fxdata) target->fxdata = heap_alloc(512);
-				memcpy(target->fxdata, &src->regs.fxdata[0], 512);
+				fpu_set_state(target, (const void*) src->regs.fxdata);
 			}
 
 			target->usr_eip = src->usr_ip;
@@ -294,6 +550,138 @@ void kcall(struct thread *image) {
 		break;
 	}
 
+	case KCALL_SETDL: {
+
+		struct thread *target = thread_get(image->ebx);
+		if (image->ebx == (uint32_t) -1) target = image;
+
+		struct t_dl *src = (void*) image->ecx;
+
+		if (!target) {
+			image->eax = TE_EXIST;
+		}
+		else if (src->period > DL_PERIOD_MAX) {
+			image->eax = TE_PARAM;
+		}
+		else {
+
+			// take thread off its run queue while its class changes
+			if (target->state == TS_QUEUED) {
+				schedule_remv(target);
+			}
+
+			image->eax = schedule_setdl(target, 
+				dl_us2clock(src->period),
+				dl_us2clock(src->budget),
+				dl_us2clock(src->deadline ? src->deadline : src->period));
+
+			// a refused request leaves the old reservation's count
+			if (image->eax == 0) {
+				target->dl_misses = 0;
+			}
+
+			if (target->state == TS_QUEUED) {
+				schedule_push(target);
+			}
+		}
+
+		break;
+	}
+
+	case KCALL_GETDL: {
+
+		struct thread *target = thread_get(image->ebx);
+		if (image->ebx == (uint32_t) -1) target = image;
+
+		struct t_dl *dest = (void*) image->ecx;
+
+		if (!target) {
+			image->eax = TE_EXIST;
+		}
+		else if (!(target->sched_flags & SF_DEADLINE)) {
+			image->eax = TE_STATE;
+		}
+		else {
+			dest->period   = dl_clock2us(target->dl_period);
+			dest->budget   = dl_clock2us(target->dl_budget);
+			dest->deadline = dl_clock2us(target->dl_deadline);
+			dest->misses   = target->dl_misses;
+			image->eax = 0;
+		}
+
+		break;
+	}
+
+	case KCALL_FUTEXWAIT: {
+
+		image->eax = futex_wait(image, image->ebx, image->ecx);
+		break;
+	}
+
+	case KCALL_FUTEXWAKE: {
+
+		// returns the number of threads woken
+		image->eax = futex_wake(image, image->ebx, (int) image->ecx);
+		break;
+	}
+
+	case KCALL_GETUSAGE: {
+
+		struct thread *target = thread_get(image->ebx);
+		if (image->ebx == (uint32_t) -1) target = image;
+
+		if (!target) {
+			image->eax = TE_EXIST;
+		}
+		else {
+			*((struct t_usage*) image->ecx) = target->usage;
+			image->eax = 0;
+		}
+
+		break;
+	}
+
+	case KCALL_SETTLS: {
+
+		struct thread *target = thread_get(image->ebx);
+		if (image->ebx == (uint32_t) -1) target = image;
+
+		if (!target) {
+			image->eax = TE_EXIST;
+		}
+		else {
+			target->tls_base = image->ecx;
+			if (target == image) {
+				set_tls_base(target->tls_base);
+			}
+			image->eax = 0;
+		}
+
+		break;
+	}
+
+	case KCALL_GETTLS: {
+
+		struct thread *target = thread_get(image->ebx);
+		if (image->ebx == (uint32_t) -1) target = image;
+
+		image->eax = (target) ? target->tls_base : 0;
+
+		break;
+	}
+
+	case KCALL_PCTXUSAGE: {
+
+		if (pctx_get_usage(image->ebx, (void*) image->ecx)) {
+			image->eax = TE_EXIST;
+		}
+		else {
+			image->eax = 0;
+		}
+
+		break;
+	}
+
 	case KCALL_GETDEAD: {
 
 		if (dead_peek()) {
@@ -327,11 +715,61 @@ void kcall(struct thread *image) {
 	}
 
 	case KCALL_WAIT: {
+		uint64_t timeout = image->ecx | (uint64_t) image->edx << 32;
 		
 		image->eax = event_wait(image->id, image->ebx);
 
+		if (timeout && image->state == TS_WAITING) {
+			wheel_add(image, timer_clock() + time_ns2clock(timeout));
+		}
+
+		break;
+
+	}
+
+	case KCALL_WAITSET: {
+		uint64_t timeout = image->ecx | (uint64_t) image->edx << 32;
+
+		waitset_wait(image, (const void*) image->ebx);
+
+		if (timeout && image->state == TS_WAITING) {
+			wheel_add(image, timer_clock() + time_ns2clock(timeout));
+		}
+
+		break;
+	}
+
+	case KCALL_SLEEP:
+	case KCALL_SLEEPUNTIL: {
+		uint64_t ns = image->ebx | (uint64_t) image->ecx << 32;
+		uint64_t now = timer_clock();
+		uint64_t expiry;
+
+		if (image->eax == KCALL_SLEEP) {
+			expiry = now + time_ns2clock(ns);
+		}
+		else {
+			expiry = time_ns2clock(ns);
+		}
+
+		image->eax = 0;
+
+		if (expiry > now) {
+			thread_save(image);
+			image->state = TS_WAITING;
+			image->event = -1;
+			wheel_add(image, expiry);
+		}
+
 		break;
+	}
 
+	case KCALL_GETTIME: {
+
+		*((uint64_t*) image->ebx) = time_clock2ns(timer_clock());
+		image->eax = 0;
+
+		break;
 	}
 
 	case KCALL_RESET: {
@@ -348,11 +786,46 @@ void kcall(struct thread *image) {
 		break;
 	}
 
+	case KCALL_EVMODE: {
+
+		image->eax = event_setmode(image->ebx, image->ecx) ? TE_PARAM : 0;
+
+		break;
+	}
+
+	case KCALL_EVRING: {
+
+		image->eax = evring_set(image, image->ebx, (const void*) image->ecx);
+
+		break;
+	}
+
+	case KCALL_EVRWAIT: {
+		uint64_t timeout = image->ebx | (uint64_t) image->ecx << 32;
+
+		if (evring_wait(image)) {
+			image->eax = TE_STATE;
+		}
+		else if (timeout && image->state == TS_WAITING) {
+			wheel_add(image, timer_clock() + time_ns2clock(timeout));
+		}
+
+		break;
+	}
+
+	case KCALL_IRQMODE: {
+
+		image->eax = irq_setmode(image->ebx, image->ecx, image->edx) ? TE_PARAM : 0;
+
+		break;
+	}
+
 	case KCALL_SYSRET: {
 
 		// save system state
 		image->sys_eip = image->eip;
 		image->sys_esp = image->useresp;
+		set_gate_stack(image->sys_esp);
 		
 		// perform return value swap-in
 		image->eax = image->ebp;
@@ -370,6 +843,21 @@ void kcall(struct thread *image) {
 		break;
 	}
 
+	case KCALL_BATCH: {
+
+		kcall_batch(image);
+
+		break;
+	}
+
+	case KCALL_SETGATE: {
+
+		gate_set_entry(image->ebx);
+		image->eax = 0;
+
+		break;
+	}
+
 	case KCALL_NEWPCTX: {
 
 		image->eax = pctx_new();
@@ -388,6 +876,7 @@ void kcall(struct thread *image) {
 	case KCALL_SETFRAME: {
 
 		page_set(image->ebx, page_fmt(image->ecx, page_get(image->ebx)));
+		kcall_flush(image->ebx);
 		image->eax = 0;
 
 		break;
@@ -396,11 +885,43 @@ void kcall(struct thread *image) {
 	case KCALL_SETFLAGS: {
 
 		page_set(image->ebx, page_fmt(page_ufmt(page_get(image->ebx)), image->ecx));
+		kcall_flush(image->ebx);
 		image->eax = 0;
 
 		break;
 	}
 
+	case KCALL_MAPV: {
+
+		const struct k_mapping *map = (const void*) image->ebx;
+
+		image->eax = mem_map(map, image->ecx) ? TE_PARAM : 0;
+
+		break;
+	}
+
+	case KCALL_UNMAP: {
+
+		image->eax = mem_unmap(image->ebx, image->ecx);
+
+		break;
+	}
+
+	case KCALL_PROTECT: {
+
+		image->eax = mem_protect(image->ebx, image->ecx, image->edx);
+
+		break;
+	}
+
+	case KCALL_ALLOC:
+	case KCALL_FREE: {
+
+		image->eax = kcall_mem(image);
+
+		break;
+	}
+
 	case KCALL_GETFRAME: {
 
 		uint32_t off  = image->ebx & 0xFFF;
@@ -462,6 +983,10 @@ static void save_info(struct t_info *dest, struct thread *src) {
 	dest->fault = src->fault;
 	dest->fault_addr = src->fault_addr;
 
+	dest->sched_priority = src->sched_priority;
+	dest->sched_flags    = src->sched_flags;
+	dest->sched_ticks    = src->tick;
+
 	if (src->state != TS_RUNNING) {
 
 		dest->regs.edi = src->edi;
@@ -475,11 +1000,119 @@ static void save_info(struct t_info *dest, struct thread *src) {
 		dest->regs.eip = src->eip;
 		dest->regs.eflags = src->eflags;
 	
-		if (src->fxdata) {
-			memcpy(&dest->regs.fxdata[0], src->fxdata, 512);
-		}
+		fpu_get_state(src, (void*) dest->regs.fxdata);
 	}
 
 	dest->usr_ip = src->usr_eip;
 	dest->usr_sp = src->usr_esp;
 }
+
+/*****************************************************************************
+ * kcall_batchable
+ *
+ * Returns nonzero if the given kcall may be submitted through a kcall ring.
+ * These are the kcalls that never block or switch out the calling thread.
+ * SETSTATE is left out, since it can pause or kill the caller or load another
+ * paging context while the batch is still reading the caller's ring, and 
+ * FREEPCTX is only batchable for paging contexts other than the caller's.
+ */
+
+static int kcall_batchable(uint32_t call) {
+
+	switch (call) {
+	case KCALL_KINFO:
+	case KCALL_SPAWN:
+	case KCALL_RESUME:
+	case KCALL_GETSTATE:
+	case KCALL_FUTEXWAKE:
+	case KCALL_GETUSAGE:
+	case KCALL_SETTLS:
+	case KCALL_GETTLS:
+	case KCALL_PCTXUSAGE:
+	case KCALL_NEWPCTX:
+	case KCALL_FREEPCTX:
+	case KCALL_SETFRAME:
+	case KCALL_SETFLAGS:
+	case KCALL_MAPV:
+	case KCALL_UNMAP:
+	case KCALL_PROTECT:
+	case KCALL_ALLOC:
+	case KCALL_FREE:
+	case KCALL_GETFRAME:
+	case KCALL_GETFLAGS:
+	case KCALL_NEWFRAME:
+	case KCALL_FREEFRAME:
+	case KCALL_TAKEFRAME:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/*****************************************************************************
+ * kcall_batch
+ *
+ * Run the kcalls queued in the submission ring of the struct k_ring at 
+ * image->ebx, in order, posting a completion for each one, until the
+ * submission ring is empty or the completion ring is full. TLB shootdowns 
+ * are done once for the whole batch, except that pending ones are done 
+ * before any frame is freed, so no processor can still reach a freed frame.
+ * Returns the number of kcalls run.
+ */
+
+static void kcall_batch(struct thread *image) {
+	struct k_ring *ring = (void*) image->ebx;
+	uint32_t saved[3];
+	uint32_t prev = 0;
+	int count = 0;
+
+	saved[0] = image->ebx;
+	saved[1] = image->ecx;
+	saved[2] = image->edx;
+
+	kcall_batching = 1;
+
+	while (ring->sq_head != ring->sq_tail 
+			&& ring->cq_tail - ring->cq_head <= ring->mask) {
+		struct k_sqe *sqe = &ring->sq[ring->sq_head & ring->mask];
+		struct k_cqe *cqe = &ring->cq[ring->cq_tail & ring->mask];
+
+		cqe->data = sqe->data;
+
+		if (!kcall_batchable(sqe->call) || (sqe->call == KCALL_FREEPCTX 
+				&& (int) sqe->arg0 == image->pctx)) {
+			cqe->result  = -1;
+			cqe->result2 = 0;
+		}
+		else {
+			if (sqe->call == KCALL_FREEFRAME || sqe->call == KCALL_UNMAP
+					|| sqe->call == KCALL_FREE) {
+				kcall_flush_finish();
+			}
+
+			image->eax = sqe->call;
+			image->ebx = sqe->arg0;
+			image->ecx = (sqe->flags & KSQE_PREV) ? prev : sqe->arg1;
+			image->edx = sqe->arg2;
+
+			kcall_dispatch(image);
+
+			cqe->result  = image->eax;
+			cqe->result2 = image->ebx;
+		}
+
+		prev = cqe->result;
+
+		ring->sq_head++;
+		ring->cq_tail++;
+		count++;
+	}
+
+	kcall_flush_finish();
+	kcall_batching = 0;
+
+	image->ebx = saved[0];
+	image->ecx = saved[1];
+	image->edx = saved[2];
+	image->eax = count;
+}
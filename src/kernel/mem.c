@@ -14,8 +14,14 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <config/address.h>
 #include <stdint.h>
+#include <pinion.h>
+
+#include "string.h"
 #include "space.h"
+#include "smp.h"
+#include "cpu.h"
 
 /****************************************************************************
  * mem_alloc
@@ -32,3 +38,207 @@ void mem_alloc(uintptr_t base, uintptr_t size, uint16_t flags) {
 		}
 	}
 }
+
+/****************************************************************************
+ * mem_flush
+ *
+ * Invalidates the TLB entries of <count> pages, which have been changed with
+ * page_put(), on all processors that may have them. The pages are those at
+ * map[i].vaddr if <map> is given, or else those starting at <base>. Locally,
+ * this is done page by page up to MEM_FLUSH_MAX pages, and by a full flush 
+ * above that. If any of the pages is in the (shared) system region, every 
+ * other processor flushes, not just those in the current paging context.
+ */
+
+static void mem_flush(uintptr_t base, int count, const struct k_mapping *map) {
+	uintptr_t high = base + (count - 1) * PAGESZ;
+
+	if (!count) {
+		return;
+	}
+
+	if (map) {
+		high = 0;
+		for (int i = 0; i < count; i++) {
+			if (map[i].vaddr > high) {
+				high = map[i].vaddr;
+			}
+		}
+	}
+
+	if (count > MEM_FLUSH_MAX) {
+		cpu_flush_tlb_full();
+	}
+	else for (int i = 0; i < count; i++) {
+		cpu_flush_tlb_part(map ? map[i].vaddr : base + i * PAGESZ);
+	}
+
+	smp_flush_tlb(high >= SYSTEM_ADDR_BASE ? -1 : cpu_get()->pctx);
+}
+
+/****************************************************************************
+ * mem_range_valid
+ *
+ * Returns nonzero if <count> pages starting at page-aligned <base> are all 
+ * below the kernel and do not wrap around.
+ */
+
+static int mem_range_valid(uintptr_t base, int count) {
+
+	if ((base & 0xFFF) || count < 0) {
+		return 0;
+	}
+
+	return count <= (int) ((KERNEL_ADDR_BASE - base) / PAGESZ)
+		&& base < KERNEL_ADDR_BASE;
+}
+
+/****************************************************************************
+ * mem_map
+ *
+ * Sets each page in an array of (vaddr, frame, flags) mappings, then 
+ * invalidates the TLB once. Returns zero on success, nonzero if any of the
+ * pages is not a valid page below the kernel (in which case nothing is
+ * changed).
+ */
+
+int mem_map(const struct k_mapping *map, int count) {
+
+	for (int i = 0; i < count; i++) {
+		if (!mem_range_valid(map[i].vaddr, 1)) {
+			return 1;
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		page_put(map[i].vaddr, page_fmt(map[i].frame, map[i].flags));
+	}
+
+	mem_flush(0, count, map);
+
+	return 0;
+}
+
+/****************************************************************************
+ * mem_unmap
+ *
+ * Unmaps <count> pages starting at <base>, freeing the frames of the pages
+ * that were present. The frames are only freed once no processor can still
+ * reach them through its TLB. Returns the number of frames freed, or -1 if 
+ * the range is invalid.
+ */
+
+int mem_unmap(uintptr_t base, int count) {
+	int freed = 0;
+
+	if (!mem_range_valid(base, count)) {
+		return -1;
+	}
+
+	/* make the pages not present, but remember their frames */
+	for (int i = 0; i < count; i++) {
+		frame_t page = page_get(base + i * PAGESZ);
+
+		if (page & PF_PRES) {
+			page_put(base + i * PAGESZ, page_ufmt(page));
+			freed++;
+		}
+		else if (page) {
+			page_put(base + i * PAGESZ, 0);
+		}
+	}
+
+	if (!freed) {
+		return 0;
+	}
+
+	mem_flush(base, count, NULL);
+
+	/* free the frames */
+	for (int i = 0; i < count; i++) {
+		frame_t page = page_get(base + i * PAGESZ);
+
+		if (page) {
+			frame_free(page_ufmt(page));
+			page_put(base + i * PAGESZ, 0);
+		}
+	}
+
+	return freed;
+}
+
+/****************************************************************************
+ * mem_protect
+ *
+ * Changes the flags of every present page among the <count> pages starting
+ * at <base> to <flags> (the pages stay present). Returns the number of pages
+ * changed, or -1 if the range is invalid.
+ */
+
+int mem_protect(uintptr_t base, int count, uint16_t flags) {
+	int changed = 0;
+
+	if (!mem_range_valid(base, count)) {
+		return -1;
+	}
+
+	for (int i = 0; i < count; i++) {
+		frame_t page = page_get(base + i * PAGESZ);
+
+		if (page & PF_PRES) {
+			page_put(base + i * PAGESZ, page_fmt(page, flags | PF_PRES));
+			changed++;
+		}
+	}
+
+	if (changed) {
+		mem_flush(base, count, NULL);
+	}
+
+	return changed;
+}
+
+/****************************************************************************
+ * mem_anon
+ *
+ * Backs every page that is not present among the <count> pages starting at
+ * <base> with a fresh frame, mapped with the given flags, and zeroes the new
+ * pages if <zero> is set. Pages are cleared through a mapping that differs
+ * from the final one at most in being writable, so no TLB flush is needed 
+ * for pages that were not present, except when the final mapping is 
+ * read-only. Returns the number of pages allocated, or -1 if the
+ * range is invalid.
+ */
+
+int mem_anon(uintptr_t base, int count, uint16_t flags, bool zero) {
+	int allocated = 0;
+
+	if (!mem_range_valid(base, count)) {
+		return -1;
+	}
+
+	for (int i = 0; i < count; i++) {
+		uintptr_t page = base + i * PAGESZ;
+		frame_t frame;
+
+		if (page_get(page) & PF_PRES) {
+			continue;
+		}
+
+		frame = frame_new();
+
+		if (zero) {
+			page_put(page, page_fmt(frame, (flags & PF_MASK) | PF_PRES | PF_RW));
+			memclr((void*) page, PAGESZ);
+		}
+
+		page_put(page, page_fmt(frame, (flags & PF_MASK) | PF_PRES));
+		allocated++;
+	}
+
+	if (allocated && zero && !(flags & PF_RW)) {
+		mem_flush(base, count, NULL);
+	}
+
+	return allocated;
+}
@@ -54,6 +54,23 @@ void page_set(uintptr_t page, frame_t value) {
 	cpu_flush_tlb_part(page);
 }
 
+/****************************************************************************
+ * page_put
+ *
+ * Sets a page in the current address space to a value, without invalidating
+ * its TLB entry. The caller is responsible for flushing the TLB before the 
+ * old value of the page could matter.
+ */
+
+void page_put(uintptr_t page, frame_t value) {
+
+	if ((cmap[page >> 22] & PF_PRES) == 0) {
+		page_touch(page);
+	}
+
+	ctbl[page >> 12] = value;
+}
+
 /****************************************************************************
  * page_touch
  *
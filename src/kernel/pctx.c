@@ -20,9 +20,11 @@
 #include <pinion.h>
 
 #include "string.h"
+#include "idtab.h"
 #include "space.h"
 #include "debug.h"
 #include "pctx.h"
+#include "smp.h"
 #include "cpu.h"
 
 static void space_exmap(space_t space);
@@ -30,51 +32,143 @@ static space_t space_alloc(void);
 static space_t space_clone(void);
 static void space_free(space_t space);
 
-static space_t _pctx_table[PCTX_COUNT];
-int _active_pctx;
+/*****************************************************************************
+ * _pctx_table
+ *
+ * Table of paging contexts, by ID. Paging context 0 is the template the 
+ * others are cloned from, and is never loaded; its usage totals are those 
+ * of the threads that have not been given a paging context.
+ */
+
+struct pctx {
+	space_t space;
+	struct t_usage usage;
+};
+
+static struct idtab _pctx_table = IDTAB_INIT;
+static struct pctx _pctx_zero;
+
+static struct pctx *pctx_get(int pctx) {
+	return (void*) idtab_get(&_pctx_table, pctx);
+}
 
 static void _pctx_init(void) {
-	_pctx_table[0] = space_clone();
+	_pctx_zero.space = space_clone();
+	idtab_alloc(&_pctx_table, (uintptr_t) &_pctx_zero);
 }
 
 int pctx_new(void) {
+	struct pctx *pctx;
+	int id;
 	
-	if (!_pctx_table[0]) {
+	if (!_pctx_table.count) {
 		_pctx_init();
 	}
 
-	for (int i = 0; i < PCTX_COUNT; i++) {
-		if (!_pctx_table[i]) {
-			_pctx_table[i] = space_clone();
-			return i;
-		}
+	pctx = heap_alloc(sizeof(struct pctx));
+	if (!pctx) {
+		return -1;
+	}
+
+	id = idtab_alloc(&_pctx_table, (uintptr_t) pctx);
+	if (id < 0) {
+		heap_free(pctx, sizeof(struct pctx));
+		return -1;
 	}
 
-	return -1;
+	pctx->space = space_clone();
+
+	return id;
 }
 
 int pctx_free(int pctx) {
+	struct pctx *p = pctx_get(pctx);
 
-	if (pctx <= 0 || pctx >= PCTX_COUNT) return 1;
-	if (!_pctx_table[pctx]) return 1;
+	if (pctx <= 0 || !p) return 1;
 
-	space_free(_pctx_table[pctx]);
-	_pctx_table[pctx] = 0;
+	space_free(p->space);
+	idtab_free(&_pctx_table, pctx);
+	heap_free(p, sizeof(struct pctx));
 
 	return 0;
 }
 
 int pctx_load(int pctx) {
+	struct pctx *p = pctx_get(pctx);
 
-	if (pctx <= 0 || pctx >= PCTX_COUNT) return 1;
-	if (!_pctx_table[pctx]) return 1;
+	if (pctx <= 0 || !p) return 1;
 
-	cpu_set_cr3(_pctx_table[pctx]);
-	_active_pctx = pctx;
+	cpu_set_cr3(p->space);
+	cpu_get()->pctx = pctx;
 
 	return 0;
 }
 
+/*****************************************************************************
+ * pctx_usage
+ *
+ * Returns the resource usage totals of threads that have since exited or 
+ * moved out of the given paging context, or NULL if it does not exist. Live
+ * threads' usage is added when the totals are requested, which keeps the 
+ * accounting on the hot paths to a single per-thread counter.
+ */
+
+struct t_usage *pctx_usage(int pctx) {
+	struct pctx *p;
+
+	if (pctx == 0) {
+		return &_pctx_zero.usage;
+	}
+
+	p = pctx_get(pctx);
+
+	return p ? &p->usage : NULL;
+}
+
+/*****************************************************************************
+ * pctx_count, pctx_limit
+ *
+ * Return the number of allocated paging contexts, and the maximum number of
+ * paging contexts.
+ */
+
+int pctx_count(void) {
+	return _pctx_table.count;
+}
+
+int pctx_limit(void) {
+	return IDTAB_MAX;
+}
+
+/****************************************************************************
+ * pctx_enter
+ *
+ * Temporarily loads paging context <pctx>, so that its user memory can be
+ * changed. Returns the previous value of CR3, to be passed to pctx_leave()
+ * along with the previous paging context, or zero if <pctx> does not exist.
+ */
+
+uint32_t pctx_enter(int pctx) {
+	uint32_t cr3 = cpu_get_cr3();
+
+	if (pctx_load(pctx)) {
+		return 0;
+	}
+
+	return cr3;
+}
+
+/****************************************************************************
+ * pctx_leave
+ *
+ * Returns to paging context <pctx> with CR3 value <cr3> after pctx_enter().
+ */
+
+void pctx_leave(int pctx, uint32_t cr3) {
+	cpu_set_cr3(cr3);
+	cpu_get()->pctx = pctx;
+}
+
 /****************************************************************************
  * space_alloc
  *
@@ -17,6 +17,9 @@
 #ifndef KERNEL_PCTX_H
 #define KERNEL_PCTX_H
 
+#include <stdint.h>
+#include <pinion.h>
+
 /*****************************************************************************
  * paging contexts
  *
@@ -26,6 +29,12 @@ int pctx_new (void);
 int pctx_free(int pctx);
 int pctx_load(int pctx);
 
-extern int _active_pctx;
+uint32_t pctx_enter(int pctx);
+void     pctx_leave(int pctx, uint32_t cr3);
+
+struct t_usage *pctx_usage(int pctx);
+
+int pctx_count(void);
+int pctx_limit(void);
 
 #endif/*KERNEL_PCTX_H*/
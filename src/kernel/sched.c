@@ -0,0 +1,849 @@
+/*
+ * Copyright (C) 2012 Nick Johnson <nickbjohnson4224 at gmail.com>
+ * 
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "interrupt.h"
+#include "thread.h"
+#include "smp.h"
+
+/*****************************************************************************
+ * Scheduling classes
+ *
+ * Threads with SF_DEADLINE set are in the deadline class: each has a budget
+ * of processor time per period, enforced by a constant bandwidth server, and
+ * the one with the earliest absolute deadline runs ahead of everything else.
+ * Threads with SF_FIXED set are in the fixed-priority class: they are kept
+ * in one FIFO run queue per priority level, and run ahead of threads in the
+ * fair class. All other threads are in the fair class, where each thread 
+ * accumulates virtual runtime (real runtime scaled inversely by a weight 
+ * derived from its priority) and the thread with the least virtual runtime 
+ * runs next.
+ */
+
+#define SCHED_LATENCY (TIMER_HZ / 128) // sleeper credit (in clock ticks)
+#define SCHED_WAKEUP  (TIMER_HZ / 1024) // wakeup preemption granularity
+
+/*****************************************************************************
+ * sched_queue
+ *
+ * Array of doubly linked FIFO run queues, one per thread priority level. The
+ * queue for priority p is sched_queue[p - SP_MIN], so higher priorities have
+ * higher indices.
+ */
+
+static struct sched_queue {
+	struct thread *head;
+	struct thread *tail;
+} sched_queue[SP_COUNT];
+
+/*****************************************************************************
+ * sched_bitmap
+ *
+ * Bit n is set if and only if sched_queue[n] is nonempty. This allows the
+ * highest priority runnable thread to be found with a single bit scan.
+ */
+
+static uint32_t sched_bitmap;
+
+/*****************************************************************************
+ * sched_fair
+ *
+ * Pairing heap of runnable fair-class threads, keyed by virtual runtime.
+ */
+
+static struct thread *sched_fair;
+
+/*****************************************************************************
+ * sched_min_vruntime
+ *
+ * Monotonically increasing lower bound on the virtual runtime of runnable 
+ * fair-class threads. Threads that wake up are placed relative to it, so 
+ * that sleeping does not bank an unbounded amount of processor time.
+ */
+
+static uint64_t sched_min_vruntime;
+
+/*****************************************************************************
+ * sched_edf, sched_throttled
+ *
+ * Pairing heaps of deadline-class threads. Runnable threads are in sched_edf,
+ * keyed by absolute deadline. Threads that have used up their budget for the
+ * current period are in sched_throttled, keyed by the time their budget is
+ * replenished.
+ */
+
+static struct thread *sched_edf;
+static struct thread *sched_throttled;
+
+/*****************************************************************************
+ * sched_dl_util
+ *
+ * Total bandwidth (budget / min(deadline, period)) reserved by deadline-class
+ * threads, as a 16.16 fixed point number. Admission control keeps this below
+ * SCHED_DL_UTIL, leaving the rest of the processor to the other classes.
+ */
+
+#define SCHED_DL_UTIL (65536 * 9 / 10)
+
+static uint32_t sched_dl_util;
+
+/*****************************************************************************
+ * sched_wmult
+ *
+ * Inverse fair-class weights, indexed by priority - SP_MIN, as 16.16 fixed
+ * point numbers. Each priority level gets about 1.25 times the processor 
+ * time of the level below it; priority 0 has a multiplier of 1.
+ */
+
+static const uint32_t sched_wmult[SP_COUNT] = {
+	2314098, 1864135, 1491308, 1198372, 958698, 762600, 610080, 489845,
+	390167,  312134,  250406,  199728,  160164, 128070, 102456, 81940,
+	65536,   52428,   41943,   33554,   26843,  21474,  17180,  13743,
+	10994,   8796,    7036,    5629,    4503,   3602,   2882,   2305,
+};
+
+/*****************************************************************************
+ * sched_level
+ *
+ * Returns the run queue index for the given thread's priority. Priorities
+ * outside of the range SP_MIN to SP_MAX are clamped into it.
+ */
+
+static int sched_level(struct thread *thread) {
+
+	if (thread->sched_priority < SP_MIN) return 0;
+	if (thread->sched_priority > SP_MAX) return SP_COUNT - 1;
+
+	return thread->sched_priority - SP_MIN;
+}
+
+/* pairing heap *************************************************************/
+
+/*****************************************************************************
+ * heap_meld
+ *
+ * Meld two heap-ordered trees, returning the new root. The roots must have no
+ * siblings.
+ */
+
+static struct thread *heap_meld(struct thread *a, struct thread *b) {
+	struct thread *t;
+
+	if (!a) return b;
+	if (!b) return a;
+
+	if (b->heap_key < a->heap_key) {
+		t = a;
+		a = b;
+		b = t;
+	}
+
+	/* make b the first child of a */
+	b->heap_prev = a;
+	b->heap_next = a->heap_child;
+	if (a->heap_child) {
+		a->heap_child->heap_prev = b;
+	}
+	a->heap_child = b;
+
+	return a;
+}
+
+/*****************************************************************************
+ * heap_merge
+ *
+ * Merge a list of sibling trees into a single tree using the standard
+ * two-pass method, returning the new root.
+ */
+
+static struct thread *heap_merge(struct thread *first) {
+	struct thread *pairs = NULL;
+	struct thread *root = NULL;
+	struct thread *a, *b;
+
+	/* meld pairs left to right, stacking the results */
+	while (first) {
+		a = first;
+		b = first->heap_next;
+		first = (b) ? b->heap_next : NULL;
+
+		a->heap_next = a->heap_prev = NULL;
+		if (b) b->heap_next = b->heap_prev = NULL;
+
+		a = heap_meld(a, b);
+		a->heap_next = pairs;
+		pairs = a;
+	}
+
+	/* meld the results right to left */
+	while (pairs) {
+		a = pairs;
+		pairs = pairs->heap_next;
+		a->heap_next = NULL;
+
+		root = heap_meld(root, a);
+	}
+
+	if (root) {
+		root->heap_prev = NULL;
+	}
+
+	return root;
+}
+
+/*****************************************************************************
+ * heap_push
+ *
+ * Add a thread to the heap with root <*root>, keyed by its heap_key.
+ */
+
+static void heap_push(struct thread **root, struct thread *thread) {
+
+	thread->heap_child = NULL;
+	thread->heap_next  = NULL;
+	thread->heap_prev  = NULL;
+
+	*root = heap_meld(*root, thread);
+}
+
+/*****************************************************************************
+ * heap_remv
+ *
+ * Remove a thread from the heap with root <*root>. Returns zero on success,
+ * nonzero if the thread is not in the heap.
+ */
+
+static int heap_remv(struct thread **root, struct thread *thread) {
+	struct thread *sub;
+
+	if (thread == *root) {
+		*root = heap_merge(thread->heap_child);
+	}
+	else if (!thread->heap_prev) {
+		return 1;
+	}
+	else {
+
+		/* detach thread (and its subtree) from the tree */
+		if (thread->heap_prev->heap_child == thread) {
+			thread->heap_prev->heap_child = thread->heap_next;
+		}
+		else {
+			thread->heap_prev->heap_next = thread->heap_next;
+		}
+		if (thread->heap_next) {
+			thread->heap_next->heap_prev = thread->heap_prev;
+		}
+
+		/* put its children back */
+		sub = heap_merge(thread->heap_child);
+		*root = heap_meld(*root, sub);
+	}
+
+	thread->heap_child = NULL;
+	thread->heap_next  = NULL;
+	thread->heap_prev  = NULL;
+
+	return 0;
+}
+
+/* fair class ***************************************************************/
+
+/*****************************************************************************
+ * fair_update_min
+ *
+ * Advance sched_min_vruntime given that <vruntime> is the virtual runtime of
+ * a runnable thread.
+ */
+
+static void fair_update_min(uint64_t vruntime) {
+
+	if (sched_fair && sched_fair->heap_key < vruntime) {
+		vruntime = sched_fair->heap_key;
+	}
+
+	if (vruntime > sched_min_vruntime) {
+		sched_min_vruntime = vruntime;
+	}
+}
+
+/*****************************************************************************
+ * fair_charge
+ *
+ * Add the processor time used by a running fair-class thread since it was
+ * last charged to its virtual runtime.
+ */
+
+static void fair_charge(struct thread *thread, uint64_t now) {
+	uint64_t delta = now - thread->sched_stamp;
+
+	if (delta > 0xFFFFFFFF) delta = 0xFFFFFFFF;
+
+	thread->vruntime += (delta * sched_wmult[sched_level(thread)]) >> 16;
+	thread->sched_stamp = now;
+
+	fair_update_min(thread->vruntime);
+}
+
+/*****************************************************************************
+ * fair_place
+ *
+ * Place a thread that is becoming runnable in virtual time. A thread that
+ * has been sleeping gets at most SCHED_LATENCY / 2 of credit relative to
+ * the other runnable threads.
+ */
+
+static void fair_place(struct thread *thread) {
+	uint64_t floor;
+
+	floor = (sched_min_vruntime > SCHED_LATENCY / 2) ?
+		sched_min_vruntime - SCHED_LATENCY / 2 : 0;
+
+	if (thread->vruntime < floor) {
+		thread->vruntime = floor;
+	}
+}
+
+/* deadline class ***********************************************************/
+
+/*****************************************************************************
+ * dl_bandwidth
+ *
+ * Returns the bandwidth reserved by a deadline-class thread, or that would
+ * be reserved with the given parameters (dl_util), as a 16.16 fixed point 
+ * number.
+ */
+
+static uint32_t dl_util(uint32_t period, uint32_t budget, uint32_t deadline) {
+	uint32_t span;
+
+	span = (deadline < period) ? deadline : period;
+
+	return ((uint64_t) budget << 16) / span;
+}
+
+static uint32_t dl_bandwidth(struct thread *thread) {
+	return dl_util(thread->dl_period, thread->dl_budget, thread->dl_deadline);
+}
+
+/*****************************************************************************
+ * dl_charge
+ *
+ * Subtract the processor time used by a running deadline-class thread since 
+ * it was last charged from its remaining budget.
+ */
+
+static void dl_charge(struct thread *thread, uint64_t now) {
+
+	thread->dl_runtime -= (int64_t) (now - thread->sched_stamp);
+	thread->sched_stamp = now;
+}
+
+/*****************************************************************************
+ * dl_release
+ *
+ * Returns the time the next period of a deadline-class thread starts, which
+ * is when its budget is replenished if it is throttled.
+ */
+
+static uint64_t dl_release(struct thread *thread) {
+	return thread->dl_abs - thread->dl_deadline + thread->dl_period;
+}
+
+/*****************************************************************************
+ * dl_push
+ *
+ * Make a deadline-class thread runnable, applying the constant bandwidth
+ * server rules. If its deadline has passed, or if its remaining budget 
+ * would exceed its reserved bandwidth before its current deadline, it gets a
+ * fresh budget and deadline. If it is out of budget, it is throttled until
+ * its next period starts.
+ */
+
+static void dl_push(struct thread *thread) {
+	uint64_t now = timer_clock();
+	uint64_t left;
+
+	if (thread->dl_runtime <= 0 && !thread->dl_yield) {
+		/* job overran its budget */
+		thread->dl_misses++;
+	}
+	thread->dl_yield = 0;
+
+	if (thread->dl_abs <= now) {
+		thread->dl_abs     = now + thread->dl_deadline;
+		thread->dl_runtime = thread->dl_budget;
+	}
+	else if (thread->dl_runtime > 0) {
+		left = thread->dl_abs - now;
+		if (left > 0xFFFFFFFF) left = 0xFFFFFFFF;
+
+		if ((uint64_t) thread->dl_runtime * thread->dl_period 
+				> left * thread->dl_budget) {
+			thread->dl_abs     = now + thread->dl_deadline;
+			thread->dl_runtime = thread->dl_budget;
+		}
+	}
+
+	if (thread->dl_runtime <= 0) {
+		thread->dl_throttled = 1;
+		thread->heap_key = dl_release(thread);
+		heap_push(&sched_throttled, thread);
+	}
+	else {
+		thread->heap_key = thread->dl_abs;
+		heap_push(&sched_edf, thread);
+	}
+}
+
+/*****************************************************************************
+ * schedule_setdl
+ *
+ * Set the deadline-class parameters of a thread that is not queued, in timer
+ * clock ticks. If <period> is zero, the thread leaves the deadline class. 
+ * Returns zero on success, TE_PARAM if the parameters are invalid, or 
+ * TE_RESRC if admitting the thread would overcommit the processor. On 
+ * failure, the thread keeps its old reservation (if any) unchanged.
+ */
+
+int schedule_setdl(struct thread *thread, uint32_t period, uint32_t budget,
+		uint32_t deadline) {
+	uint32_t util, old = 0;
+
+	if (period && (!budget || budget > deadline || deadline > period)) {
+		return TE_PARAM;
+	}
+
+	if (thread->sched_flags & SF_DEADLINE) {
+		old = dl_bandwidth(thread);
+	}
+
+	/* leave the deadline class */
+	if (!period) {
+		sched_dl_util -= old;
+		thread->sched_flags &= ~SF_DEADLINE;
+		return 0;
+	}
+
+	/* admission control, counting the old reservation as released */
+	util = dl_util(period, budget, deadline);
+	if (sched_dl_util - old + util > SCHED_DL_UTIL) {
+		return TE_RESRC;
+	}
+	sched_dl_util = sched_dl_util - old + util;
+
+	thread->dl_period   = period;
+	thread->dl_budget   = budget;
+	thread->dl_deadline = deadline;
+
+	thread->sched_flags |= SF_DEADLINE;
+	thread->dl_abs      = timer_clock() + deadline;
+	thread->dl_runtime  = budget;
+	thread->dl_throttled = 0;
+	thread->dl_yield    = 0;
+
+	return 0;
+}
+
+/*****************************************************************************
+ * schedule_yield
+ *
+ * Called when a thread yields the processor. For a deadline-class thread, 
+ * this ends its job for the current period: it is throttled until the next
+ * period, and a deadline miss is recorded if the job finished late.
+ */
+
+void schedule_yield(struct thread *thread) {
+
+	if (!(thread->sched_flags & SF_DEADLINE)) {
+		return;
+	}
+
+	if (timer_clock() > thread->dl_abs) {
+		thread->dl_misses++;
+	}
+
+	thread->dl_runtime = 0;
+	thread->dl_yield = 1;
+}
+
+/*****************************************************************************
+ * schedule_clock
+ *
+ * Called from the timer interrupt. Replenishes the budgets of throttled
+ * deadline-class threads whose next period has started, and returns nonzero
+ * if the given running thread has used up its budget and must be preempted.
+ */
+
+int schedule_clock(struct thread *active, uint64_t now) {
+	struct thread *thread;
+
+	while (sched_throttled && sched_throttled->heap_key <= now) {
+		thread = sched_throttled;
+		heap_remv(&sched_throttled, thread);
+
+		thread->dl_abs = dl_release(thread) + thread->dl_deadline;
+		thread->dl_runtime = thread->dl_budget;
+		thread->dl_throttled = 0;
+
+		thread->heap_key = thread->dl_abs;
+		heap_push(&sched_edf, thread);
+		smp_wake();
+	}
+
+	if (active && (active->sched_flags & SF_DEADLINE)) {
+		dl_charge(active, now);
+		return active->dl_runtime <= 0;
+	}
+
+	return 0;
+}
+
+/*****************************************************************************
+ * schedule_timer
+ *
+ * Returns the next clock time at which the scheduler needs a timer interrupt
+ * (for budget exhaustion of the given running thread or replenishment of a
+ * throttled thread), or zero if it does not need one.
+ */
+
+uint64_t schedule_timer(struct thread *active) {
+	uint64_t next = 0;
+	uint64_t t;
+
+	if (sched_throttled) {
+		next = sched_throttled->heap_key;
+	}
+
+	if (active && (active->sched_flags & SF_DEADLINE)) {
+		t = active->sched_stamp;
+		if (active->dl_runtime > 0) t += active->dl_runtime;
+		if (!next || t < next) next = t;
+	}
+
+	return next;
+}
+
+/* scheduler ****************************************************************/
+
+/*****************************************************************************
+ * sched_enqueue
+ *
+ * Add a thread to the run queue for its class. Fixed-priority threads are 
+ * added to the tail of the run queue for their priority; fair threads are 
+ * added to the fair heap.
+ */
+
+static void sched_enqueue(struct thread *thread) {
+
+	if (thread->sched_flags & SF_DEADLINE) {
+		dl_push(thread);
+
+		return;
+	}
+
+	if (!(thread->sched_flags & SF_FIXED)) {
+		fair_place(thread);
+		thread->heap_key = thread->vruntime;
+		heap_push(&sched_fair, thread);
+
+		return;
+	}
+
+	struct sched_queue *queue = &sched_queue[sched_level(thread)];
+
+	thread->next = NULL;
+	thread->prev = queue->tail;
+
+	if (!queue->tail) {
+		queue->head = thread;
+	}
+	else {
+		queue->tail->next = thread;
+	}
+	queue->tail = thread;
+
+	sched_bitmap |= 1 << sched_level(thread);
+}
+
+/*****************************************************************************
+ * schedule_push
+ *
+ * Make a thread runnable, waking an idle processor to run it if there is one.
+ * Returns zero on success, nonzero on failure.
+ */
+
+int schedule_push(struct thread *thread) {
+
+	sched_enqueue(thread);
+	smp_wake();
+
+	return 0;
+}
+
+/*****************************************************************************
+ * schedule_push_front
+ *
+ * Make a thread that was preempted before the end of its timeslice runnable
+ * again, at the head of its run queue if it is a fixed-priority thread (the
+ * other classes are ordered by deadline or virtual runtime, which already 
+ * favor it). Returns zero on success, nonzero on failure.
+ */
+
+int schedule_push_front(struct thread *thread) {
+
+	if (!(thread->sched_flags & SF_FIXED) || (thread->sched_flags & SF_DEADLINE)) {
+		return schedule_push(thread);
+	}
+
+	struct sched_queue *queue = &sched_queue[sched_level(thread)];
+
+	thread->prev = NULL;
+	thread->next = queue->head;
+
+	if (!queue->head) {
+		queue->tail = thread;
+	}
+	else {
+		queue->head->prev = thread;
+	}
+	queue->head = thread;
+
+	sched_bitmap |= 1 << sched_level(thread);
+	smp_wake();
+
+	return 0;
+}
+
+/*****************************************************************************
+ * schedule_remv
+ *
+ * Remove a thread from whatever run queue it is in. Returns zero on success,
+ * nonzero if the thread is not in a run queue.
+ */
+
+int schedule_remv(struct thread *thread) {
+
+	if (thread->sched_flags & SF_DEADLINE) {
+		if (thread->dl_throttled) {
+			thread->dl_throttled = 0;
+			return heap_remv(&sched_throttled, thread);
+		}
+		return heap_remv(&sched_edf, thread);
+	}
+
+	if (!(thread->sched_flags & SF_FIXED)) {
+		return heap_remv(&sched_fair, thread);
+	}
+
+	struct sched_queue *queue = &sched_queue[sched_level(thread)];
+
+	if (!thread->prev && queue->head != thread) {
+		return 1;
+	}
+
+	if (thread->prev) {
+		thread->prev->next = thread->next;
+	}
+	else {
+		queue->head = thread->next;
+	}
+
+	if (thread->next) {
+		thread->next->prev = thread->prev;
+	}
+	else {
+		queue->tail = thread->prev;
+	}
+
+	thread->next = NULL;
+	thread->prev = NULL;
+
+	if (!queue->head) {
+		sched_bitmap &= ~(1 << sched_level(thread));
+	}
+
+	return 0;
+}
+
+/*****************************************************************************
+ * schedule_next
+ *
+ * Returns the thread that should be run next (i.e. the deadline thread with
+ * the earliest deadline, or failing that the head of the highest priority 
+ * nonempty run queue, or failing that the fair thread with the least virtual
+ * runtime) without removing it from its run queue. Returns NULL if no threads
+ * are queued.
+ */
+
+struct thread *schedule_next(void) {
+
+	if (sched_edf) {
+		return sched_edf;
+	}
+
+	if (!sched_bitmap) {
+		return sched_fair;
+	}
+
+	return sched_queue[31 - __builtin_clz(sched_bitmap)].head;
+}
+
+/*****************************************************************************
+ * schedule_preempt
+ *
+ * Returns nonzero if the given running thread should be preempted, zero 
+ * otherwise. Any thread is preempted by a queued deadline thread with an
+ * earlier deadline; non-deadline threads are preempted by any queued 
+ * deadline thread. A fixed-priority thread is preempted by any queued thread
+ * of strictly higher priority. A fair thread is preempted by any queued 
+ * fixed-priority thread, and by a fair thread that is behind it in virtual
+ * runtime by more than the wakeup granularity.
+ */
+
+int schedule_preempt(struct thread *thread) {
+
+	if (thread->sched_flags & SF_DEADLINE) {
+		return sched_edf && sched_edf->dl_abs < thread->dl_abs;
+	}
+
+	if (sched_edf) {
+		return 1;
+	}
+
+	if (thread->sched_flags & SF_FIXED) {
+		if (!sched_bitmap) {
+			return 0;
+		}
+
+		return (31 - __builtin_clz(sched_bitmap)) > sched_level(thread);
+	}
+
+	if (sched_bitmap) {
+		return 1;
+	}
+
+	if (!sched_fair) {
+		return 0;
+	}
+
+	fair_charge(thread, timer_clock());
+
+	return sched_fair->vruntime + SCHED_WAKEUP < thread->vruntime;
+}
+
+/*****************************************************************************
+ * schedule_throttled
+ *
+ * Returns nonzero if <thread> is a deadline thread that has used up its 
+ * budget, and so must not be switched to directly (by IRQ handoff or 
+ * YIELDTO) before its replenishment.
+ */
+
+int schedule_throttled(struct thread *thread) {
+	return (thread->sched_flags & SF_DEADLINE) && thread->dl_throttled;
+}
+
+/*****************************************************************************
+ * schedule_handoff
+ *
+ * Returns nonzero if <thread>, just woken by an IRQ, should take over the
+ * processor from the running thread <active> (NULL if the processor is idle)
+ * right away. This is only done for threads with SF_HANDOFF set, and never
+ * to a thread that <active> could preempt: a deadline thread only yields to
+ * an earlier deadline, and a fixed-priority thread only to a fixed-priority
+ * thread of at least its priority. A deadline thread that has used up its 
+ * budget waits for its replenishment like any other.
+ */
+
+int schedule_handoff(struct thread *active, struct thread *thread) {
+
+	if (!(thread->sched_flags & SF_HANDOFF)) {
+		return 0;
+	}
+
+	if (schedule_throttled(thread)) {
+		return 0;
+	}
+
+	if (!active) {
+		return 1;
+	}
+
+	if (active->sched_flags & SF_DEADLINE) {
+		return (thread->sched_flags & SF_DEADLINE) 
+			&& thread->dl_abs < active->dl_abs;
+	}
+
+	if (thread->sched_flags & SF_DEADLINE) {
+		return 1;
+	}
+
+	if (active->sched_flags & SF_FIXED) {
+		return (thread->sched_flags & SF_FIXED)
+			&& sched_level(thread) >= sched_level(active);
+	}
+
+	return 1;
+}
+
+/*****************************************************************************
+ * schedule_tick
+ *
+ * Returns nonzero if the given running thread should give up the processor 
+ * at the end of its timeslice, zero if it should keep running. Threads with
+ * SF_FIFO set are only preempted by higher priority threads, and deadline
+ * threads are only preempted by earlier deadlines or budget exhaustion.
+ */
+
+int schedule_tick(struct thread *thread) {
+
+	if (thread->sched_flags & SF_DEADLINE) {
+		return schedule_preempt(thread);
+	}
+
+	if ((thread->sched_flags & SF_FIXED) && (thread->sched_flags & SF_FIFO)) {
+		return schedule_preempt(thread);
+	}
+
+	return 1;
+}
+
+/*****************************************************************************
+ * schedule_start
+ *
+ * Called when a thread starts running on the processor.
+ */
+
+void schedule_start(struct thread *thread) {
+	thread->sched_stamp = timer_clock();
+}
+
+/*****************************************************************************
+ * schedule_stop
+ *
+ * Called when a thread stops running on the processor. Charges the thread
+ * for the processor time it used.
+ */
+
+void schedule_stop(struct thread *thread) {
+
+	if (thread->sched_flags & SF_DEADLINE) {
+		dl_charge(thread, timer_clock());
+	}
+	else if (!(thread->sched_flags & SF_FIXED)) {
+		fair_charge(thread, timer_clock());
+	}
+}
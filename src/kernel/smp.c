@@ -0,0 +1,758 @@
+/*
+ * Copyright (C) 2012 Nick Johnson <nickbjohnson4224 at gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <config/address.h>
+
+#include "interrupt.h"
+#include "string.h"
+#include "thread.h"
+#include "space.h"
+#include "debug.h"
+#include "smp.h"
+#include "cpu.h"
+
+/* per-CPU state ************************************************************/
+
+/*****************************************************************************
+ * gdt
+ *
+ * The BSP's GDT, defined in "kernel/boot.s". Each AP gets a copy of it.
+ */
+
+extern uint8_t gdt[CPU_GDT_SIZE];
+
+/*****************************************************************************
+ * cpu_data, cpu_table, cpu_count
+ *
+ * Per-CPU state of every processor that has been brought up, indexed by
+ * logical processor number in cpu_data and by local APIC ID in cpu_table.
+ * Until smp_init() runs, every lookup goes to entry 0, which is the BSP.
+ */
+
+static struct cpu cpu_data[CPU_MAX] = { { .gdt = gdt } };
+static struct cpu *cpu_table[256]   = { &cpu_data[0] };
+int cpu_count = 1;
+
+/*****************************************************************************
+ * cpu_kstack, lapic_id
+ *
+ * Used by the interrupt entry code in "kernel/int.s" to find the kernel
+ * stack of the current processor: lapic_id points to the local APIC ID
+ * register (or to a zero word if there is no local APIC), and cpu_kstack
+ * maps local APIC IDs to the tops of kernel stacks. The boot stack from
+ * "kernel/boot.s" is used until smp_init() runs.
+ */
+
+extern uint8_t kstack[];
+
+static uint32_t lapic_zero;
+volatile uint32_t *lapic_id = &lapic_zero;
+void *cpu_kstack[256] = { &kstack[0x1FF0] };
+
+/*****************************************************************************
+ * cpu_get
+ *
+ * Returns the per-CPU state of the current processor.
+ */
+
+struct cpu *cpu_get(void) {
+	return cpu_table[*lapic_id >> 24];
+}
+
+/*****************************************************************************
+ * cpu_lookup
+ *
+ * Returns the per-CPU state of the processor with the given logical number.
+ */
+
+struct cpu *cpu_lookup(int id) {
+	return &cpu_data[id];
+}
+
+/* local APIC ***************************************************************/
+
+#define LAPIC_ADDR 0xFF020000 // virtual address of the local APIC
+
+#define LAPIC_ID         0x020
+#define LAPIC_TPR        0x080
+#define LAPIC_EOI        0x0B0
+#define LAPIC_SVR        0x0F0
+#define LAPIC_ICRL       0x300
+#define LAPIC_ICRH       0x310
+#define LAPIC_LVT_TIMER  0x320
+#define LAPIC_TIMER_INIT 0x380
+#define LAPIC_TIMER_CUR  0x390
+#define LAPIC_TIMER_DIV  0x3E0
+
+#define LAPIC_SVR_ENABLE    0x100
+#define LAPIC_TIMER_PERIODIC 0x20000
+#define LAPIC_TIMER_MASKED  0x10000
+#define LAPIC_TIMER_DIV16   0x3
+
+#define ICR_FIXED   0x0000
+#define ICR_INIT    0x0500
+#define ICR_STARTUP 0x0600
+#define ICR_PENDING 0x1000
+#define ICR_ASSERT  0x4000
+
+#define LAPIC_TIMER_HZ 64 // preemption frequency on APs
+
+static volatile uint32_t *lapic;
+static uint32_t lapic_period;
+
+static uint32_t lapic_read(uint32_t reg) {
+	return lapic[reg >> 2];
+}
+
+static void lapic_write(uint32_t reg, uint32_t value) {
+	lapic[reg >> 2] = value;
+}
+
+/*****************************************************************************
+ * lapic_eoi
+ *
+ * Signal the end of a local APIC interrupt.
+ */
+
+void lapic_eoi(void) {
+	lapic_write(LAPIC_EOI, 0);
+}
+
+/*****************************************************************************
+ * lapic_ipi
+ *
+ * Send an interprocessor interrupt with the given ICR command to the
+ * processor with the given local APIC ID, and wait for it to be accepted.
+ */
+
+static void lapic_ipi(uint8_t apic_id, uint32_t command) {
+
+	lapic_write(LAPIC_ICRH, (uint32_t) apic_id << 24);
+	lapic_write(LAPIC_ICRL, command);
+
+	while (lapic_read(LAPIC_ICRL) & ICR_PENDING);
+}
+
+/*****************************************************************************
+ * lapic_enable
+ *
+ * Software-enable the current processor's local APIC and accept all
+ * interrupt priorities.
+ */
+
+static void lapic_enable(void) {
+	lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | LAPIC_VECTOR_SPURIOUS);
+	lapic_write(LAPIC_TPR, 0);
+}
+
+/*****************************************************************************
+ * lapic_calibrate
+ *
+ * Measure the local APIC timer frequency against the timer clock, and set
+ * lapic_period to the number of local APIC timer counts (divided by 16) in
+ * one AP timeslice. All processors share a bus clock, so this is only done
+ * once, on the BSP.
+ */
+
+static void lapic_calibrate(void) {
+	uint64_t start;
+
+	lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV16);
+	lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_MASKED | LAPIC_VECTOR_TIMER);
+	lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+
+	start = timer_clock();
+	while (timer_clock() - start < TIMER_HZ / LAPIC_TIMER_HZ);
+
+	lapic_period = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CUR);
+	lapic_write(LAPIC_TIMER_INIT, 0);
+}
+
+/*****************************************************************************
+ * lapic_timer_start
+ *
+ * Start the current processor's local APIC timer in periodic mode, firing
+ * LAPIC_TIMER_HZ times per second.
+ */
+
+static void lapic_timer_start(void) {
+	lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV16);
+	lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | LAPIC_VECTOR_TIMER);
+	lapic_write(LAPIC_TIMER_INIT, lapic_period);
+}
+
+/* kernel lock **************************************************************/
+
+/*****************************************************************************
+ * smp_kernel_lock, smp_idle_mask
+ *
+ * The kernel lock serializes all kernel code: it is held from the start of
+ * int_handler() to just before it returns. smp_idle_mask has a bit set for
+ * each processor that is halted with nothing to run.
+ */
+
+static volatile int smp_kernel_lock;
+static volatile uint32_t smp_idle_mask;
+
+/*****************************************************************************
+ * smp_lock
+ *
+ * Acquire the kernel lock. While waiting for it, the processor services TLB
+ * flush requests, because the processor holding the lock may be waiting for
+ * this one to flush. A processor holding the lock is not idle.
+ */
+
+void smp_lock(void) {
+	struct cpu *cpu = cpu_get();
+
+	while (__sync_lock_test_and_set(&smp_kernel_lock, 1)) {
+		while (smp_kernel_lock) {
+			if (cpu->flush) {
+				cpu_flush_tlb_full();
+				cpu->flush = 0;
+			}
+			__asm__ volatile ("pause");
+		}
+	}
+
+	if (cpu->flush) {
+		cpu_flush_tlb_full();
+		cpu->flush = 0;
+	}
+
+	__sync_fetch_and_and(&smp_idle_mask, ~(1 << cpu->id));
+}
+
+/*****************************************************************************
+ * smp_unlock
+ *
+ * Release the kernel lock.
+ */
+
+void smp_unlock(void) {
+	__sync_lock_release(&smp_kernel_lock);
+}
+
+/* multiprocessor operations ************************************************/
+
+/*****************************************************************************
+ * smp_idle
+ *
+ * Mark the current processor as idle, release the kernel lock, and halt until
+ * the next interrupt. Never returns.
+ */
+
+void smp_idle(void) {
+	struct cpu *cpu = cpu_get();
+
+	__sync_fetch_and_or(&smp_idle_mask, 1 << cpu->id);
+	smp_unlock();
+
+	cpu_idle(&cpu->idle_stack[CPU_IDLE_SIZE - 16]);
+}
+
+/*****************************************************************************
+ * smp_kick
+ *
+ * Interrupt the given processor so that it reenters the scheduler.
+ */
+
+void smp_kick(struct cpu *cpu) {
+
+	if (lapic && cpu != cpu_get()) {
+		lapic_ipi(cpu->apic_id, ICR_ASSERT | ICR_FIXED | LAPIC_VECTOR_WAKE);
+	}
+}
+
+/*****************************************************************************
+ * smp_wake
+ *
+ * Called when a thread is queued: wakes one idle processor (if there are
+ * any) to run it.
+ */
+
+void smp_wake(void) {
+	uint32_t mask = smp_idle_mask;
+
+	for (int i = 0; i < cpu_count; i++) {
+		if (mask & (1 << i)) {
+			__sync_fetch_and_and(&smp_idle_mask, ~(1 << i));
+			smp_kick(&cpu_data[i]);
+			return;
+		}
+	}
+}
+
+/*****************************************************************************
+ * smp_flush_tlb
+ *
+ * Make every other processor that has the given paging context loaded flush
+ * its TLB, and wait for them to do so. If <pctx> is -1, all other processors
+ * flush. Must be called with the kernel lock held.
+ */
+
+void smp_flush_tlb(int pctx) {
+	struct cpu *self = cpu_get();
+	int i;
+
+	for (i = 0; i < cpu_count; i++) {
+		struct cpu *cpu = &cpu_data[i];
+
+		if (cpu != self && (pctx == -1 || cpu->pctx == pctx)) {
+			cpu->flush = 1;
+			lapic_ipi(cpu->apic_id, ICR_ASSERT | ICR_FIXED | LAPIC_VECTOR_FLUSH);
+		}
+	}
+
+	for (i = 0; i < cpu_count; i++) {
+		while (cpu_data[i].flush) {
+			__asm__ volatile ("pause");
+		}
+	}
+}
+
+/*****************************************************************************
+ * smp_timer_handler (interrupt handler)
+ *
+ * Local APIC timer handler for APs, which do not get PIT interrupts. Runs
+ * the deadline scheduler and preempts the current thread at the end of its
+ * timeslice.
+ */
+
+static void smp_timer_handler(struct thread *image) {
+	struct thread *active = thread_get_active();
+	int preempt;
+
+	lapic_eoi();
+
+	cpu_get()->kdata->ticks++;
+	cpu_get()->kdata->clock = timer_clock();
+
+	if (!active || active->state != TS_RUNNING) {
+		return;
+	}
+
+	active->tick++;
+
+	preempt = schedule_clock(active, timer_clock());
+	if (preempt || schedule_tick(active)) {
+		thread_preempt(active);
+	}
+}
+
+/*****************************************************************************
+ * smp_ipi_handler (interrupt handler)
+ *
+ * Handler for wakeup and TLB shootdown IPIs. The work is done by smp_lock()
+ * and int_handler(); this just acknowledges the interrupt.
+ */
+
+static void smp_ipi_handler(struct thread *image) {
+	lapic_eoi();
+}
+
+/* processor discovery ******************************************************/
+
+#define SMP_MAP_ADDR  0xFF030000 // virtual window for reading firmware tables
+#define SMP_MAP_PAGES 4
+
+/*****************************************************************************
+ * smp_map
+ *
+ * Map the physical memory at <addr> into a temporary window and return its
+ * virtual address. At least (SMP_MAP_PAGES - 1) pages after <addr> are
+ * accessible. The mapping is only valid until the next call.
+ */
+
+static void *smp_map(uint32_t addr) {
+
+	for (uint32_t i = 0; i < SMP_MAP_PAGES; i++) {
+		page_set(SMP_MAP_ADDR + i * PAGESZ,
+			page_fmt((addr & ~0xFFF) + i * PAGESZ, PF_PRES));
+	}
+
+	return (void*) (SMP_MAP_ADDR + (addr & 0xFFF));
+}
+
+static int smp_sigcmp(const void *a, const char *sig, int n) {
+	const char *s = a;
+
+	for (int i = 0; i < n; i++) {
+		if (s[i] != sig[i]) return 1;
+	}
+
+	return 0;
+}
+
+static uint8_t smp_checksum(const void *a, int n) {
+	const uint8_t *s = a;
+	uint8_t sum = 0;
+
+	for (int i = 0; i < n; i++) {
+		sum += s[i];
+	}
+
+	return sum;
+}
+
+/*****************************************************************************
+ * smp_scan
+ *
+ * Search the EBDA and the BIOS ROM area for a structure with the given
+ * signature and checksum length, aligned on 16 bytes. Returns its physical
+ * address, or zero if it is not found.
+ */
+
+static uint32_t smp_scan(const char *sig, int siglen, int sumlen) {
+	uint32_t ebda = (uint32_t) *((uint16_t*) (KERNEL_ADDR_BASE + 0x40E)) << 4;
+	uint32_t area[2][2] = { { ebda, ebda + 0x400 }, { 0xE0000, 0x100000 } };
+
+	for (int i = 0; i < 2; i++) {
+		for (uint32_t addr = area[i][0]; addr < area[i][1]; addr += 16) {
+			uint8_t *ptr = (void*) (KERNEL_ADDR_BASE + addr);
+
+			if (!smp_sigcmp(ptr, sig, siglen) && !smp_checksum(ptr, sumlen)) {
+				return addr;
+			}
+		}
+	}
+
+	return 0;
+}
+
+struct acpi_rsdp {
+	char     signature[8];
+	uint8_t  checksum;
+	char     oem[6];
+	uint8_t  revision;
+	uint32_t rsdt;
+} __attribute__ ((packed));
+
+struct acpi_header {
+	char     signature[4];
+	uint32_t length;
+	uint8_t  revision;
+	uint8_t  checksum;
+	char     oem[6];
+	char     oem_table[8];
+	uint32_t oem_revision;
+	uint32_t creator;
+	uint32_t creator_revision;
+} __attribute__ ((packed));
+
+struct acpi_madt {
+	struct acpi_header header;
+	uint32_t lapic;
+	uint32_t flags;
+	uint8_t  entries[];
+} __attribute__ ((packed));
+
+/*****************************************************************************
+ * smp_parse_madt
+ *
+ * Find the local APIC IDs of all enabled processors and the physical address
+ * of the local APIC using the ACPI MADT. Returns the number of processors
+ * found, or -1 if there is no MADT.
+ */
+
+static int smp_parse_madt(uint8_t *ids, uint32_t *lapic_phys) {
+	struct acpi_rsdp *rsdp;
+	struct acpi_header *rsdt;
+	struct acpi_madt *madt;
+	uint32_t rsdt_addr, madt_addr, count, i;
+	int n;
+
+	rsdp = (void*) smp_scan("RSD PTR ", 8, 20);
+	if (!rsdp) return -1;
+	rsdp = (void*) ((uintptr_t) rsdp + KERNEL_ADDR_BASE);
+	rsdt_addr = rsdp->rsdt;
+
+	/* find MADT in RSDT */
+	rsdt = smp_map(rsdt_addr);
+	if (smp_sigcmp(rsdt->signature, "RSDT", 4)) return -1;
+	count = (rsdt->length - sizeof(struct acpi_header)) / 4;
+
+	madt_addr = 0;
+	for (i = 0; i < count; i++) {
+		rsdt = smp_map(rsdt_addr);
+		uint32_t entry = ((uint32_t*) &rsdt[1])[i];
+
+		if (!smp_sigcmp(smp_map(entry), "APIC", 4)) {
+			madt_addr = entry;
+			break;
+		}
+	}
+	if (!madt_addr) return -1;
+
+	/* read processor local APIC entries */
+	madt = smp_map(madt_addr);
+	*lapic_phys = madt->lapic;
+
+	n = 0;
+	for (i = sizeof(struct acpi_madt); i + 2 <= madt->header.length; ) {
+		uint8_t *entry = (uint8_t*) madt + i;
+
+		if (entry[1] < 2) break;
+
+		if (entry[0] == 0 && (entry[4] & 1) && n < CPU_MAX) {
+			ids[n++] = entry[3];
+		}
+
+		i += entry[1];
+	}
+
+	return n;
+}
+
+struct mp_float {
+	char     signature[4];
+	uint32_t config;
+	uint8_t  length;
+	uint8_t  revision;
+	uint8_t  checksum;
+	uint8_t  features[5];
+} __attribute__ ((packed));
+
+struct mp_config {
+	char     signature[4];
+	uint16_t length;
+	uint8_t  revision;
+	uint8_t  checksum;
+	char     oem[8];
+	char     product[12];
+	uint32_t oem_table;
+	uint16_t oem_table_size;
+	uint16_t entry_count;
+	uint32_t lapic;
+	uint16_t ext_length;
+	uint8_t  ext_checksum;
+	uint8_t  reserved;
+} __attribute__ ((packed));
+
+/*****************************************************************************
+ * smp_parse_mp
+ *
+ * Find the local APIC IDs of all enabled processors and the physical address
+ * of the local APIC using the Intel MultiProcessor configuration table.
+ * Returns the number of processors found, or -1 if there is no table.
+ */
+
+static int smp_parse_mp(uint8_t *ids, uint32_t *lapic_phys) {
+	struct mp_float *mpf;
+	struct mp_config *mpc;
+	uint8_t *entry;
+	int n;
+
+	mpf = (void*) smp_scan("_MP_", 4, 16);
+	if (!mpf) return -1;
+	mpf = (void*) ((uintptr_t) mpf + KERNEL_ADDR_BASE);
+	if (!mpf->config) return -1;
+
+	mpc = smp_map(mpf->config);
+	if (smp_sigcmp(mpc->signature, "PCMP", 4)) return -1;
+	*lapic_phys = mpc->lapic;
+
+	n = 0;
+	entry = (uint8_t*) &mpc[1];
+	for (int i = 0; i < mpc->entry_count; i++) {
+		if (entry[0] == 0) {
+			if ((entry[3] & 1) && n < CPU_MAX) {
+				ids[n++] = entry[1];
+			}
+			entry += 20;
+		}
+		else {
+			entry += 8;
+		}
+	}
+
+	return n;
+}
+
+/* AP startup ***************************************************************/
+
+#define SMP_TRAMPOLINE 0x7000 // physical address of AP startup code
+
+/*****************************************************************************
+ * smp_trampoline
+ *
+ * AP startup code, defined in "kernel/smp.s". It is copied to SMP_TRAMPOLINE,
+ * and its parameters (page directory, initial stack, and per-CPU state) are
+ * filled in before each AP is started.
+ */
+
+extern uint8_t smp_trampoline[];
+extern uint8_t smp_trampoline_end[];
+extern uint8_t smp_tramp_cr3[];
+extern uint8_t smp_tramp_stack[];
+extern uint8_t smp_tramp_cpu[];
+
+static void smp_tramp_set(uint8_t *param, uint32_t value) {
+	uint32_t offset = (uintptr_t) param - (uintptr_t) smp_trampoline;
+
+	*((volatile uint32_t*) (KERNEL_ADDR_BASE + SMP_TRAMPOLINE + offset)) = value;
+}
+
+/*****************************************************************************
+ * smp_delay
+ *
+ * Busy-wait for the given number of microseconds, or until <flag> becomes
+ * nonzero if it is not NULL.
+ */
+
+static void smp_delay(uint32_t us, volatile int *flag) {
+	uint64_t end = timer_clock() + (((uint64_t) us << 20) / 1000000);
+
+	while (timer_clock() < end) {
+		if (flag && *flag) return;
+	}
+}
+
+/*****************************************************************************
+ * smp_ap_main
+ *
+ * First C code run on an AP, called from the trampoline on the AP's kernel
+ * stack. Sets up the AP's descriptor tables, local APIC and FPU, and then
+ * idles until there is something to run.
+ */
+
+void smp_ap_main(struct cpu *cpu) {
+
+	cpu_set_gdt(cpu->gdt);
+	int_init_cpu(cpu);
+
+	lapic_enable();
+	lapic_timer_start();
+
+	cpu_init_fpu();
+
+	cpu->online = 1;
+
+	/* the BSP holds the kernel lock until it is done booting */
+	smp_lock();
+	smp_idle();
+}
+
+/*****************************************************************************
+ * smp_boot_ap
+ *
+ * Start the AP with the given local APIC ID using the INIT-SIPI-SIPI
+ * sequence. Returns zero on success, nonzero if it did not come up.
+ */
+
+static int smp_boot_ap(uint8_t apic_id) {
+	struct cpu *cpu = &cpu_data[cpu_count];
+
+	cpu->id      = cpu_count;
+	cpu->apic_id = apic_id;
+	cpu->gdt     = cpu->gdt_copy;
+	memcpy(cpu->gdt, gdt, CPU_GDT_SIZE);
+
+	cpu_table[apic_id]  = cpu;
+	cpu_kstack[apic_id] = &cpu->kstack[CPU_KSTACK_SIZE - 16];
+
+	smp_tramp_set(smp_tramp_cr3,   cpu_get_cr3());
+	smp_tramp_set(smp_tramp_stack, (uintptr_t) &cpu->kstack[CPU_KSTACK_SIZE - 16]);
+	smp_tramp_set(smp_tramp_cpu,   (uintptr_t) cpu);
+
+	/* INIT-SIPI-SIPI */
+	lapic_ipi(apic_id, ICR_ASSERT | ICR_INIT);
+	smp_delay(10000, NULL);
+
+	lapic_ipi(apic_id, ICR_ASSERT | ICR_STARTUP | (SMP_TRAMPOLINE >> 12));
+	smp_delay(200, &cpu->online);
+
+	if (!cpu->online) {
+		lapic_ipi(apic_id, ICR_ASSERT | ICR_STARTUP | (SMP_TRAMPOLINE >> 12));
+	}
+	smp_delay(100000, &cpu->online);
+
+	if (!cpu->online) {
+		cpu_table[apic_id]  = NULL;
+		cpu_kstack[apic_id] = NULL;
+		return 1;
+	}
+
+	cpu_count++;
+	return 0;
+}
+
+/*****************************************************************************
+ * smp_init
+ *
+ * Enable the BSP's local APIC, find all other processors using the ACPI MADT
+ * or the MP table, and start them. Must be called by the BSP with the kernel
+ * lock held, after the timer and FPU have been initialized. The APs stay idle
+ * until the kernel lock is released.
+ */
+
+void smp_init(void) {
+	struct cpu *bsp = &cpu_data[0];
+	uint32_t lapic_phys = 0xFEE00000;
+	uint8_t ids[CPU_MAX];
+	int n;
+
+	/* check for local APIC */
+	if (!(cpu_get_id(1) & (1 << 9))) {
+		debug_printf("smp: no local APIC\n");
+		return;
+	}
+
+	n = smp_parse_madt(ids, &lapic_phys);
+	if (n < 0) {
+		n = smp_parse_mp(ids, &lapic_phys);
+	}
+	if (n < 0) {
+		debug_printf("smp: no MADT or MP table\n");
+		return;
+	}
+
+	/* map and enable local APIC */
+	page_set(LAPIC_ADDR, page_fmt(lapic_phys, PF_PRES | PF_RW | PF_WRTT | PF_DISC));
+	lapic = (void*) LAPIC_ADDR;
+	lapic_enable();
+	lapic_calibrate();
+
+	/* switch per-CPU lookups to the local APIC ID */
+	bsp->apic_id = lapic_read(LAPIC_ID) >> 24;
+	bsp->online  = 1;
+	cpu_table[bsp->apic_id]  = bsp;
+	cpu_kstack[bsp->apic_id] = &bsp->kstack[CPU_KSTACK_SIZE - 16];
+	lapic_id = &lapic[LAPIC_ID >> 2];
+
+	int_set_handler(LAPIC_VECTOR_TIMER, smp_timer_handler);
+	int_set_handler(LAPIC_VECTOR_WAKE,  smp_ipi_handler);
+	int_set_handler(LAPIC_VECTOR_FLUSH, smp_ipi_handler);
+
+	/* install trampoline, identity mapped for the switch to paging */
+	memcpy((void*) (KERNEL_ADDR_BASE + SMP_TRAMPOLINE), smp_trampoline,
+		smp_trampoline_end - smp_trampoline);
+	page_set(SMP_TRAMPOLINE, page_fmt(SMP_TRAMPOLINE, PF_PRES | PF_RW));
+
+	for (int i = 0; i < n && cpu_count < CPU_MAX; i++) {
+		if (ids[i] == bsp->apic_id) {
+			continue;
+		}
+
+		if (smp_boot_ap(ids[i])) {
+			debug_printf("smp: processor %d did not start\n", ids[i]);
+		}
+	}
+
+	page_set(SMP_TRAMPOLINE, 0);
+
+	debug_printf("smp: %d processors online\n", cpu_count);
+}
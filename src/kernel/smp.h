@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2012 Nick Johnson <nickbjohnson4224 at gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef KERNEL_SMP_H
+#define KERNEL_SMP_H
+
+#include <stdint.h>
+#include <pinion.h>
+
+#include "thread.h"
+#include "cpu.h"
+
+/* per-CPU state ************************************************************/
+
+#define CPU_MAX 16 // maximum number of processors brought up
+
+#define CPU_KSTACK_SIZE 0x2000
+#define CPU_IDLE_SIZE   0x1000
+#define CPU_GDT_SIZE    88
+
+#define CPU_KDATA_ADDR  0xFF040000 // read-only per-CPU kernel data pages
+#define CPU_KDATA_KADDR 0xFF050000 // writable kernel mappings of the same
+
+struct cpu {
+
+	/* processor identity */
+	int     id;      // logical processor number (the BSP is 0)
+	uint8_t apic_id; // local APIC ID
+	volatile int online;
+
+	/* descriptor tables (the BSP uses the GDT in "boot.s") */
+	uint8_t *gdt;
+	uint8_t gdt_copy[CPU_GDT_SIZE] __attribute__ ((aligned (8)));
+	struct tss tss;
+
+	/* kernel data page (writable mapping) */
+	struct k_data *kdata;
+
+	/* base of the thread TLS segment in this processor's GDT */
+	uint32_t tls_base;
+
+	/* scheduling state */
+	struct thread *thread; // active thread
+	int pctx;              // active paging context
+
+	/* thread whose FPU/SSE state was last loaded into this processor */
+	struct thread *fpu_owner;
+
+	/* pending TLB flush request from another processor */
+	volatile int flush;
+
+	/* stacks */
+	uint8_t kstack[CPU_KSTACK_SIZE] __attribute__ ((aligned (16)));
+	uint8_t idle_stack[CPU_IDLE_SIZE] __attribute__ ((aligned (16)));
+};
+
+struct cpu *cpu_get(void);
+struct cpu *cpu_lookup(int id);
+
+extern int cpu_count;
+
+/* local APIC ***************************************************************/
+
+#define LAPIC_VECTOR_TIMER    0xF0 // local APIC timer (APs only)
+#define LAPIC_VECTOR_WAKE     0xF1 // wake/reschedule IPI
+#define LAPIC_VECTOR_FLUSH    0xF2 // TLB shootdown IPI
+#define LAPIC_VECTOR_SPURIOUS 0xFF // spurious interrupt
+
+void lapic_eoi(void);
+
+/* kernel lock **************************************************************/
+
+void smp_lock(void);
+void smp_unlock(void);
+
+/* multiprocessor operations ************************************************/
+
+void smp_init(void);
+void smp_idle(void);
+void smp_wake(void);
+void smp_kick(struct cpu *cpu);
+void smp_flush_tlb(int pctx);
+void smp_ap_main(struct cpu *cpu);
+
+#endif/*KERNEL_SMP_H*/
@@ -0,0 +1,96 @@
+; Copyright (C) 2012 Nick Johnson <nickbjohnson4224 at gmail.com>
+; 
+; Permission to use, copy, modify, and distribute this software for any
+; purpose with or without fee is hereby granted, provided that the above
+; copyright notice and this permission notice appear in all copies.
+; 
+; THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+; WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+; MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+; ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+; WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+; ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+; OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+; AP startup trampoline. This is copied to physical address TRAMPOLINE by
+; smp_init() and started there in real mode by a SIPI. It switches to
+; protected mode and paging (the page at TRAMPOLINE is temporarily identity
+; mapped) and calls smp_ap_main() on the stack it is given.
+
+section .text
+
+TRAMPOLINE equ 0x7000
+
+%define TADDR(x) (TRAMPOLINE + ((x) - smp_trampoline))
+
+extern smp_ap_main
+
+global smp_trampoline
+global smp_trampoline_end
+global smp_tramp_cr3
+global smp_tramp_stack
+global smp_tramp_cpu
+
+align 16
+[bits 16]
+smp_trampoline:
+	cli
+	cld
+	xor ax, ax
+	mov ds, ax
+	lgdt [TADDR(smp_tramp_gdt_ptr)]
+
+	mov eax, cr0
+	or eax, 0x00000001	; Set protected mode flag
+	mov cr0, eax
+	jmp dword 0x08:TADDR(smp_tramp_pmode)
+
+[bits 32]
+smp_tramp_pmode:
+	mov ax, 0x10
+	mov ds, ax
+	mov es, ax
+	mov fs, ax
+	mov gs, ax
+	mov ss, ax
+
+	mov ecx, cr4
+	or ecx, 0x00000010	; Set 4MB page flag
+	mov cr4, ecx
+	mov ecx, [TADDR(smp_tramp_cr3)]
+	mov cr3, ecx		; Use the BSP's address space
+	mov edx, cr0
+	or edx, 0x80000000	; Set paging flag
+	mov cr0, edx
+
+	mov esp, [TADDR(smp_tramp_stack)]
+	mov ebp, esp
+	push dword [TADDR(smp_tramp_cpu)]
+
+	mov eax, smp_ap_main	; Jump to the higher half
+	call eax
+
+.halt:
+	cli
+	hlt
+	jmp .halt
+
+align 8
+smp_tramp_gdt:
+	dd 0x00000000, 0x00000000
+	dd 0x0000FFFF, 0x00CF9A00
+	dd 0x0000FFFF, 0x00CF9200
+
+smp_tramp_gdt_ptr:
+	dw 0x0017
+	dd TADDR(smp_tramp_gdt)
+
+align 4
+smp_tramp_cr3:
+	dd 0
+smp_tramp_stack:
+	dd 0
+smp_tramp_cpu:
+	dd 0
+
+smp_trampoline_end:
@@ -49,12 +49,21 @@ extern frame_t *ctbl;		/* Base of current page tables */
 
 /* high level memory operations *********************************************/
 
-void   mem_alloc(uintptr_t base, uintptr_t size, uint16_t flags);
+#define MEM_FLUSH_MAX 32 // pages invalidated one by one before a full flush
+
+struct k_mapping;
+
+void   mem_alloc  (uintptr_t base, uintptr_t size, uint16_t flags);
+int    mem_anon   (uintptr_t base, int count, uint16_t flags, bool zero);
+int    mem_map    (const struct k_mapping *map, int count);
+int    mem_unmap  (uintptr_t base, int count);
+int    mem_protect(uintptr_t base, int count, uint16_t flags);
 
 /* page operations **********************************************************/
 
 void    page_touch(uintptr_t page);
 void    page_set  (uintptr_t page, frame_t value);
+void    page_put  (uintptr_t page, frame_t value);
 frame_t page_get  (uintptr_t page);
 
 #define page_fmt(base,flags) (((base)&0xFFFFF000)|((flags)&PF_MASK))
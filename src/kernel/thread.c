@@ -14,16 +14,70 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <config/address.h>
+
 #include "interrupt.h"
+#include "idtab.h"
 #include "string.h"
 #include "thread.h"
 #include "space.h"
 #include "debug.h"
 #include "pctx.h"
+#include "smp.h"
 #include "cpu.h"
 
-static struct thread *_active_thread;
-static struct thread *_thread_table[THREAD_COUNT];
+/*****************************************************************************
+ * _thread_table
+ *
+ * Table of allocated threads, by thread ID.
+ */
+
+static struct idtab _thread_table = IDTAB_INIT;
+
+static int fpu_live(struct cpu *cpu, struct thread *thread);
+
+struct wait_link {
+	struct thread *thread;
+	struct wait_list *list;
+	struct wait_link *next;
+	struct wait_link *prev;
+};
+
+struct wait_list {
+	struct wait_link *head;
+	struct wait_link *tail;
+};
+
+/* thread structure cache ***************************************************/
+
+/*****************************************************************************
+ * _thread_cache
+ *
+ * Singly linked list (through ->next) of free thread structures. Structures
+ * are carved out of page-sized slabs, each rounded up to a cache line, and 
+ * are never returned to the heap. A cached structure keeps the FPU save 
+ * area of its last thread (in ->fxcache), so it can be reused without going
+ * back to the heap either.
+ */
+
+#define THREAD_SIZE ((sizeof(struct thread) + 63) & ~63)
+
+static struct thread *_thread_cache;
+
+static void thread_cache_grow(void) {
+	uint8_t *slab = heap_alloc(PAGESZ);
+
+	if (!slab) {
+		return;
+	}
+
+	for (uint32_t i = 0; i + THREAD_SIZE <= PAGESZ; i += THREAD_SIZE) {
+		struct thread *thread = (void*) &slab[i];
+
+		thread->next = _thread_cache;
+		_thread_cache = thread;
+	}
+}
 
 /*****************************************************************************
  * thread_alloc
@@ -35,25 +89,39 @@ static struct thread *_thread_table[THREAD_COUNT];
 
 static struct thread *thread_alloc(void) {
 	struct thread *thread;
+	uint32_t *fxcache;
+	int id;
 
-	thread = heap_alloc(sizeof(struct thread));
-	thread->fxdata = heap_alloc(512);
+	if (!_thread_cache) {
+		thread_cache_grow();
 
-	memclr(thread, sizeof(struct thread));
+		if (!_thread_cache) {
+			return NULL;
+		}
+	}
 
-	int i;
-	for (i = 0; i < THREAD_COUNT; i++) {
-		if (!_thread_table[i]) break;
+	thread = _thread_cache;
+
+	id = idtab_alloc(&_thread_table, (uintptr_t) thread);
+	if (id < 0) {
+		return NULL;
 	}
-	if (i >= THREAD_COUNT) return NULL;
 
-	_thread_table[i] = thread;
-	thread->id = i;
+	_thread_cache = thread->next;
+
+	/* clear everything but the cached FPU save area */
+	fxcache = thread->fxcache;
+	memclr(thread, sizeof(struct thread));
+	thread->fxcache = fxcache;
+
+	thread->id = id;
 	thread->state = TS_PAUSED;
 
 	return thread;
 }
 
+/* thread operations ********************************************************/
+
 /*****************************************************************************
  * thread_get
  *
@@ -63,41 +131,59 @@ static struct thread *thread_alloc(void) {
  */
 
 struct thread *thread_get(int thread) {
-	if (thread < 0 || thread >= THREAD_COUNT) return NULL;
-	return _thread_table[thread];
+	return (void*) idtab_get(&_thread_table, thread);
 }
 
 /*****************************************************************************
  * thread_kill
  *
- * Free all memory associated with a given thread structure. The state of the
- * thread changes to TS_FREE.
+ * Free the ID and thread structure (back to the structure cache) of a given
+ * thread. The state of the thread changes to TS_FREE.
  */
 
 void thread_kill(struct thread *thread) {
 
-	_thread_table[thread->id] = NULL;
+	idtab_free(&_thread_table, thread->id);
 
-	/* free FPU/SSE data */
+	/* release deadline reservation */
+	schedule_setdl(thread, 0, 0, 0);
+
+	/* leave any futex queue or wait set and disarm any timeout */
+	futex_remv(thread);
+	waitset_remv(thread);
+	wheel_remv(thread);
+
+	/* stop delivering events to its ring */
+	evring_free(thread);
+
+	if (thread->wait_links) {
+		heap_free(thread->wait_links, thread->wait_size * sizeof(struct wait_link));
+	}
+
+	/* keep resource usage in paging context totals */
+	thread_retire_usage(thread);
+
+	/* keep FPU/SSE save area with the structure */
+	fpu_drop(thread);
 	if (thread->fxdata) {
-		heap_free(thread->fxdata, 512);
+		thread->fxcache = thread->fxdata;
 		thread->fxdata = NULL;
 	}
 
-	/* free thread structure */
-	heap_free(thread, sizeof(struct thread));
+	/* return thread structure to the cache */
+	thread->next = _thread_cache;
+	_thread_cache = thread;
 }
 
 /*****************************************************************************
  * thread_get_active
  * 
- * Return the actively running thread. If no thread is running, returns NULL.
- * The actively running thread is guaranteed to be the unique thread with
- * state TS_RUNNING.
+ * Return the thread actively running on the current processor. If no thread
+ * is running, returns NULL.
  */
 
 struct thread *thread_get_active(void) {
-	return _active_thread;
+	return cpu_get()->thread;
 }
 
 /*****************************************************************************
@@ -110,6 +196,7 @@ struct thread *thread_get_active(void) {
  */
 
 int thread_load(struct thread *thread) {
+	struct cpu *cpu = cpu_get();
 	
 	if (thread->vm86_active) {
 		set_int_stack(&thread->vm86_start);
@@ -117,38 +204,123 @@ int thread_load(struct thread *thread) {
 	else {
 		set_int_stack(&thread->vm86_es);
 	}
+	set_gate_stack(thread->sys_esp);
+	set_tls_base(thread->tls_base);
 
-	if (thread->fxdata) {
-		fpu_load(thread->fxdata);
+	/* trap the first FPU use unless its state is still loaded here */
+	if (fpu_live(cpu, thread)) {
+		cpu_clr_ts();
+	}
+	else {
+		cpu_set_ts();
 	}
 
-	if (thread->pctx && thread->pctx != _active_pctx) {
+	if (thread->pctx && thread->pctx != cpu->pctx) {
 		pctx_load(thread->pctx);
 	}
 
-	_active_thread = thread;
+	schedule_start(thread);
+	thread->cpu = cpu->id;
+	cpu->thread = thread;
+
+	/* publish to the kernel data page */
+	if (cpu->kdata) {
+		cpu->kdata->thread = thread->id;
+		cpu->kdata->epoch++;
+	}
 
 	return 0;
 }
 
+/*****************************************************************************
+ * thread_unload
+ *
+ * Save the processor state of a given thread that is being switched out.
+ */
+
+static void thread_unload(struct thread *thread) {
+
+	/* save FPU state if it was used since the thread was loaded */
+	if (thread && fpu_live(cpu_get(), thread) && !cpu_tst_ts()) {
+		fpu_save(thread->fxdata);
+	}
+
+	if (thread) {
+		schedule_stop(thread);
+	}
+
+	cpu_get()->thread = NULL;
+}
+
 /*****************************************************************************
  * thread_save
  *
  * Fully save the state of a given thread structure. This is only required
- * before switching to another thread.
+ * before switching to another thread. The switch is counted as voluntary.
  */
 
 int thread_save(struct thread *thread) {
 	
-	if (thread && thread->fxdata) {
-		fpu_save(thread->fxdata);
+	thread_unload(thread);
+
+	if (thread) {
+		thread->usage.vswitches++;
 	}
 
-	_active_thread = NULL;
+	return 0;
+}
+
+/*****************************************************************************
+ * thread_preempt
+ *
+ * Save the state of the given running thread and put it back on the run 
+ * queue, counting an involuntary context switch.
+ */
+
+int thread_preempt(struct thread *thread) {
+
+	thread_unload(thread);
+	thread->usage.iswitches++;
+
+	schedule_push(thread);
+	thread->state = TS_QUEUED;
+
+	return 0;
+}
+
+/*****************************************************************************
+ * thread_preempt_front
+ *
+ * Like thread_preempt(), but put the thread back at the head of its run 
+ * queue, for when it is preempted by an IRQ handoff instead of the end of
+ * its timeslice.
+ */
+
+int thread_preempt_front(struct thread *thread) {
+
+	thread_unload(thread);
+	thread->usage.iswitches++;
+
+	schedule_push_front(thread);
+	thread->state = TS_QUEUED;
 
 	return 0;
 }
 
+/*****************************************************************************
+ * thread_count, thread_limit
+ *
+ * Return the number of allocated threads, and the maximum number of threads.
+ */
+
+int thread_count(void) {
+	return _thread_table.count;
+}
+
+int thread_limit(void) {
+	return IDTAB_MAX;
+}
+
 /*****************************************************************************
  * thread_new
  *
@@ -167,56 +339,216 @@ int thread_new(void) {
 	return thread->id;
 }
 
-/* scheduler ****************************************************************/
+/* lazy FPU state ***********************************************************/
+
+/*****************************************************************************
+ * fpu_live
+ *
+ * Returns nonzero if the FPU/SSE registers of processor <cpu> hold the 
+ * current state of <thread>.
+ *
+ * Threads run with CR0.TS set unless this is true, so that their first FPU
+ * instruction traps to fpu_take(). A thread that never uses the FPU never 
+ * has its state saved or restored, and never allocates a save area. When a
+ * thread that did use the FPU is switched out, its state is saved, but also
+ * stays in the registers; if it is the next thread on that processor to use
+ * the FPU, nothing needs to be restored.
+ */
+
+static int fpu_live(struct cpu *cpu, struct thread *thread) {
+	return cpu->fpu_owner == thread && thread->fpu_cpu == cpu->id + 1;
+}
 
-struct thread *sched_head;
-struct thread *sched_tail;
+/*****************************************************************************
+ * fpu_alloc
+ *
+ * Allocates a save area of fpu_size bytes for <thread>, holding a clean FPU
+ * state, reusing the area cached with its thread structure if there is one.
+ * The heap hands out blocks aligned to their (power of two) size, so XSAVE 
+ * areas are 64-byte aligned. A zeroed XSAVE header puts everything but MXCSR
+ * in its initial state.
+ */
 
-int schedule_push(struct thread *thread) {
+static void fpu_alloc(struct thread *thread) {
 
-	if (!sched_tail) {
-		sched_head = thread;
+	if (thread->fxcache) {
+		thread->fxdata = thread->fxcache;
+		thread->fxcache = NULL;
 	}
 	else {
-		sched_tail->next = thread;
+		thread->fxdata = heap_alloc(fpu_size);
 	}
-	sched_tail = thread;
-	thread->next = NULL;
 
-	return 0;
+	memclr(thread->fxdata, fpu_size);
+
+	thread->fxdata[0] = 0x037F; // FCW: all exceptions masked
+	thread->fxdata[6] = 0x1F80; // MXCSR: all exceptions masked
 }
 
-int schedule_remv(struct thread *thread) {
-	
-	if (!sched_head) {
-		return 1;
+/*****************************************************************************
+ * fpu_take
+ *
+ * Handles the #NM fault raised by the first FPU/SSE instruction a thread 
+ * runs with CR0.TS set: gives the FPU to that thread, loading its saved 
+ * state, or a clean state if it has never used the FPU before. The state of
+ * the previous owner was already saved when it was switched out.
+ */
+
+void fpu_take(struct thread *thread) {
+	struct cpu *cpu = cpu_get();
+
+	cpu_clr_ts();
+
+	if (fpu_live(cpu, thread)) {
+		return;
 	}
 
-	if (thread == sched_head) {
-		sched_head = sched_head->next;
-		if (!sched_head) {
-			sched_tail = NULL;
+	if (!thread->fxdata) {
+		fpu_alloc(thread);
+	}
+
+	fpu_load(thread->fxdata);
+
+	cpu->fpu_owner = thread;
+	thread->fpu_cpu = cpu->id + 1;
+}
+
+/*****************************************************************************
+ * fpu_drop
+ *
+ * Makes sure no processor treats its registers as the state of <thread>, 
+ * which must not be running. Called when the saved state of the thread is
+ * replaced, or when the thread is freed.
+ */
+
+void fpu_drop(struct thread *thread) {
+
+	thread->fpu_cpu = 0;
+
+	for (int i = 0; i < cpu_count; i++) {
+		struct cpu *cpu = cpu_lookup(i);
+
+		if (cpu && cpu->fpu_owner == thread) {
+			cpu->fpu_owner = NULL;
 		}
 	}
-	else {
-		for (struct thread *t1 = sched_head; t1->next; t1 = t1->next) {
-			if (t1->next == thread) {
-				t1->next = thread->next;
-				if (sched_tail == thread) {
-					sched_tail = t1;
-				}
-				return 0;
-			}
+}
+
+/*****************************************************************************
+ * fpu_get_state, fpu_set_state
+ *
+ * Copy the legacy (FXSAVE format) part of the saved FPU state of a thread 
+ * that is not running, to or from a 512-byte buffer. This is the part of the
+ * state visible through getstate and setstate.
+ *
+ * With XSAVE, the x87 and SSE parts of the area may be stale when the header
+ * marks them as in their initial state, so their initial values are copied
+ * out instead; when setting them, they are marked as in use.
+ */
+
+void fpu_get_state(struct thread *thread, void *fxdata) {
+	uint8_t *legacy = fxdata;
+	
+	if (!thread->fxdata) {
+		return;
+	}
+
+	memcpy(legacy, thread->fxdata, 512);
+
+	if (fpu_mode >= FPU_XSAVE) {
+		if ((thread->fxdata[128] & 0x1) == 0) {
+			memclr(&legacy[0], 24);   // control, status, pointers
+			memclr(&legacy[32], 128); // ST0-ST7
+			legacy[0] = 0x7F;
+			legacy[1] = 0x03;
+		}
+		if ((thread->fxdata[128] & 0x2) == 0) {
+			memclr(&legacy[160], 256); // XMM registers
 		}
+	}
+}
 
-		return 1;
+void fpu_set_state(struct thread *thread, const void *fxdata) {
+
+	if (!thread->fxdata) {
+		fpu_alloc(thread);
 	}
 
-	return 0;
+	memcpy(thread->fxdata, fxdata, 512);
+
+	// reserved MXCSR bits would make the restore fault
+	thread->fxdata[6] &= 0xFFBF;
+
+	if (fpu_mode >= FPU_XSAVE) {
+		thread->fxdata[128] |= 0x3;
+	}
+
+	fpu_drop(thread);
+}
+
+/* resource usage ***********************************************************/
+
+/*****************************************************************************
+ * usage_add
+ *
+ * Add the difference <a> - <b> of two usage records to <dest>.
+ */
+
+static void usage_add(struct t_usage *dest, struct t_usage *a, struct t_usage *b) {
+
+	dest->run_cycles    += a->run_cycles    - b->run_cycles;
+	dest->kernel_cycles += a->kernel_cycles - b->kernel_cycles;
+	dest->vswitches     += a->vswitches     - b->vswitches;
+	dest->iswitches     += a->iswitches     - b->iswitches;
+	dest->faults        += a->faults        - b->faults;
+	dest->kcalls        += a->kcalls        - b->kcalls;
+}
+
+/*****************************************************************************
+ * thread_retire_usage
+ *
+ * Move the resource usage a thread has accumulated since it entered its 
+ * current paging context into that paging context's totals (see 
+ * pctx_usage()). Must be called before a thread exits or changes paging 
+ * contexts.
+ */
+
+void thread_retire_usage(struct thread *thread) {
+	struct t_usage *total = pctx_usage(thread->pctx);
+
+	if (total) {
+		usage_add(total, &thread->usage, &thread->usage_base);
+	}
+
+	thread->usage_base = thread->usage;
 }
 
-struct thread *schedule_next(void) {
-	return sched_head;
+/*****************************************************************************
+ * pctx_get_usage
+ *
+ * Fill <usage> with the total resource usage of all threads that have run in
+ * the given paging context. Returns zero on success, nonzero if <pctx> does
+ * not exist.
+ */
+
+int pctx_get_usage(int pctx, struct t_usage *usage) {
+	struct t_usage *total = pctx_usage(pctx);
+
+	if (!total) {
+		return 1;
+	}
+
+	*usage = *total;
+
+	for (int i = 0; i < idtab_limit(&_thread_table); i++) {
+		struct thread *thread = thread_get(i);
+
+		if (thread && thread->pctx == pctx) {
+			usage_add(usage, &thread->usage, &thread->usage_base);
+		}
+	}
+
+	return 0;
 }
 
 /* event queues *************************************************************/
@@ -227,10 +559,79 @@ static struct evqueue {
 
 	struct thread *front_thread;
 	struct thread *back_thread;
+
+	struct wait_list sets; // wait sets selecting this event
+
+	int wake; // waiters woken per event (KEV_WAKE_ALL for all), or 0 for one
+
+	struct thread *ring; // thread whose event ring receives this event
 } evqueue[EV_COUNT];
 
+/*****************************************************************************
+ * irqstate
+ *
+ * Number of interrupts pending on each IRQ. A one-shot IRQ (the default) is
+ * masked when it fires, so its count is only ever zero or one, and it stays
+ * pending until reset. A counting IRQ (KIRQ_COUNT) stays unmasked, and its 
+ * count is delivered to, and cleared by, the first waiter once it reaches 
+ * the IRQ's threshold.
+ */
+
 int irqstate[EV_COUNT];
 
+static struct irqconf {
+	int flags;
+	int threshold; // zero for one-shot IRQs
+} irqconf[EV_COUNT];
+
+static int irq_counting(int event) {
+	return event < 240 && (irqconf[event].flags & KIRQ_COUNT);
+}
+
+static int irq_ready(int event) {
+	return irqstate[event] && irqstate[event] >= irqconf[event].threshold;
+}
+
+static int irq_take(int event) {
+	int count = irqstate[event];
+
+	if (irq_counting(event)) {
+		irqstate[event] = 0;
+	}
+
+	return count;
+}
+
+/*****************************************************************************
+ * irq_setmode
+ *
+ * Make an IRQ one-shot (flags zero) or counting (KIRQ_COUNT), waking its 
+ * waiters only once <threshold> interrupts are pending. Any pending count is
+ * discarded and the line is unmasked. Returns nonzero if the IRQ is invalid
+ * or is level-triggered, which counting mode does not support.
+ */
+
+int irq_setmode(int irq, int flags, int threshold) {
+
+	if (irq <= 0 || irq >= IRQ_INT_SIZE) {
+		return 1;
+	}
+
+	if ((flags & KIRQ_COUNT) && irq_level(irq)) {
+		return 1;
+	}
+
+	irqconf[irq].flags = flags & KIRQ_COUNT;
+	irqconf[irq].threshold = (flags & KIRQ_COUNT) ? (threshold > 1 ? threshold : 1) : 0;
+	irqstate[irq] = 0;
+	irq_unmask(irq);
+
+	return 0;
+}
+
+static int wait_list_wake(struct wait_list *list, int source, int id);
+static void evring_post(struct thread *thread, int event, int count);
+
 int event_wait(int id, int event) {
 	struct thread *thread = thread_get(id);
 
@@ -249,10 +650,15 @@ int event_wait(int id, int event) {
 		return 1;
 	}
 
-	if (irqstate[event]) {
+	if (irq_ready(event)) {
+		/* deliver the pending count (or zero for a one-shot IRQ) at once */
+		thread->eax = irq_counting(event) ? irq_take(event) : 0;
+
 		thread_save(thread);
 		schedule_push(thread);
 		thread->state = TS_QUEUED;
+
+		return thread->eax;
 	}
 	else {
 		/* queue thread */
@@ -289,15 +695,15 @@ int event_remv(int id, int event) {
 	}
 
 	if (evqueue[event].front_thread == thread) {
-		evqueue[event].front_thread = thread->next;
+		evqueue[event].front_thread = thread->next_evqueue;
 		if (evqueue[event].back_thread == thread) {
 			evqueue[event].back_thread = NULL;
 		}
 		return 0;
 	}
-	else for (struct thread *t = evqueue[event].front_thread; t->next; t = t->next) {
-		if (t->next == thread) {
-			t->next = thread->next;
+	else for (struct thread *t = evqueue[event].front_thread; t->next_evqueue; t = t->next_evqueue) {
+		if (t->next_evqueue == thread) {
+			t->next_evqueue = thread->next_evqueue;
 			if (evqueue[event].back_thread == thread) {
 				evqueue[event].back_thread = t;
 			}
@@ -308,30 +714,91 @@ int event_remv(int id, int event) {
 	return 1;
 }
 
+/*****************************************************************************
+ * event_send
+ *
+ * Fire an event, waking as many of its waiters as its delivery mode asks 
+ * for: threads waiting on the event alone first, in order, then wait sets.
+ * The woken threads are cut from the wait queue as one chain (the whole 
+ * queue, in constant time, for wake-all) before they are made runnable.
+ */
+
 int event_send(int id, int event) {
+	struct thread *first, *last, *thread;
+	int value = event;
+	int count = 1;
+	int limit;
+	int woken = 0;
 
 	if (event < 0 || event >= EV_COUNT) {
 		return 1;
 	}
 
-	if (evqueue[event].front_thread) {
+	limit = evqueue[event].wake ? evqueue[event].wake : 1;
 
-		// handle event now
-		struct thread *thread = evqueue[event].front_thread;
-		evqueue[event].front_thread = thread->next_evqueue;
-		if (!thread->next_evqueue) evqueue[event].back_thread = NULL;
+	if (irq_counting(event)) {
+
+		/* acknowledge, but leave the line unmasked and count it */
+		irq_reset(event);
+		irqstate[event]++;
+
+		if (!irq_ready(event)) {
+			return 0;
+		}
+
+		if (!evqueue[event].front_thread && !evqueue[event].sets.head
+				&& !evqueue[event].ring) {
+			return 0;
+		}
+
+		count = value = irq_take(event);
+	}
+
+	if (evqueue[event].ring) {
 
-		thread->eax = event;
+		// deliver to the event ring instead of any waiter
+		evring_post(evqueue[event].ring, event, count);
+		limit = 0;
+	}
+
+	// detach the threads to wake from the queue
+	first = limit ? evqueue[event].front_thread : NULL;
+	if (first) {
+		last = first;
+
+		if (limit == KEV_WAKE_ALL) {
+			last = evqueue[event].back_thread;
+		}
+		else for (int n = 1; n < limit && last->next_evqueue; n++) {
+			last = last->next_evqueue;
+		}
+
+		evqueue[event].front_thread = last->next_evqueue;
+		if (!last->next_evqueue) evqueue[event].back_thread = NULL;
+		last->next_evqueue = NULL;
+	}
+
+	// handle event now
+	for (thread = first; thread; thread = thread->next_evqueue) {
+		thread->eax = value;
 		thread->event = -1;
+		wheel_remv(thread);
 
 		if (thread->state == TS_RUNNING) {
 			thread_save(thread);
 		}
 		schedule_push(thread);
 		thread->state = TS_QUEUED;
+		woken++;
 	}
 
-	if (event < 240) {
+	// then wake wait sets, up to the limit
+	while (limit && (limit == KEV_WAKE_ALL || woken < limit)
+			&& !wait_list_wake(&evqueue[event].sets, event, count)) {
+		woken++;
+	}
+
+	if (event < 240 && !irq_counting(event)) {
 		irq_mask(event);
 		irq_reset(event);
 		irqstate[event] = 1;
@@ -340,25 +807,880 @@ int event_send(int id, int event) {
 	return 0;
 }
 
-/* dead queue ***************************************************************/
-
-static struct thread *dead_tail;
-static struct thread *dead_head;
+int event_waiting(int event) {
 
-static struct thread *reaper_tail;
-static struct thread *reaper_head;
+	if (event < 0 || event >= EV_COUNT) {
+		return 0;
+	}
 
-int dead_push(struct thread *thread) {
+	return evqueue[event].front_thread || evqueue[event].sets.head;
+}
 
-	if (reaper_tail) {
+/*****************************************************************************
+ * event_setmode
+ *
+ * Set the number of waiters woken each time an event fires: one (the 
+ * default), <wake> of them, or all of them if <wake> is KEV_WAKE_ALL. 
+ * Returns nonzero if the event or count is invalid.
+ */
 
-		// retrieve next reaper
-		struct thread *reaper;
-		reaper = reaper_tail;
-		reaper_tail = reaper_tail->next_dead;
-		if (!reaper_tail) {
-			reaper_head = NULL;
-		}
+int event_setmode(int event, int wake) {
+
+	if (event < 0 || event >= EV_COUNT) {
+		return 1;
+	}
+
+	if (wake < 1 && wake != KEV_WAKE_ALL) {
+		return 1;
+	}
+
+	evqueue[event].wake = (wake == 1) ? 0 : wake;
+
+	return 0;
+}
+
+struct thread *event_front(int event) {
+
+	if (event < 0 || event >= EV_COUNT) {
+		return NULL;
+	}
+
+	if (evqueue[event].ring) {
+		return evqueue[event].ring;
+	}
+
+	return evqueue[event].front_thread;
+}
+
+/* wait sets ****************************************************************/
+
+/*****************************************************************************
+ * Wait sets
+ *
+ * A thread blocked in waitset_wait() is linked into the wait set list of 
+ * every source it selected (an event queue, the dead queue or the fault 
+ * queue) by one wait_link per source. The first source to fire wakes the
+ * thread and unlinks it from all of them. The links are kept with the 
+ * thread between calls, so a server waiting on the same sources in a loop 
+ * does not go back to the heap.
+ */
+
+static struct wait_list dead_sets;
+static struct wait_list fault_sets;
+
+static void wait_list_add(struct wait_list *list, struct wait_link *link) {
+
+	link->list = list;
+	link->next = NULL;
+	link->prev = list->tail;
+
+	if (list->tail) {
+		list->tail->next = link;
+	}
+	else {
+		list->head = link;
+	}
+	list->tail = link;
+}
+
+static void wait_list_remv(struct wait_link *link) {
+	struct wait_list *list = link->list;
+
+	if (link->prev) {
+		link->prev->next = link->next;
+	}
+	else {
+		list->head = link->next;
+	}
+
+	if (link->next) {
+		link->next->prev = link->prev;
+	}
+	else {
+		list->tail = link->prev;
+	}
+}
+
+/*****************************************************************************
+ * wait_list_wake
+ *
+ * Wake the first thread in a wait set list, returning <source> in its eax
+ * and <id> in its ebx. Returns nonzero if the list is empty.
+ */
+
+static int wait_list_wake(struct wait_list *list, int source, int id) {
+	struct thread *thread;
+
+	if (!list->head) {
+		return 1;
+	}
+
+	thread = list->head->thread;
+	waitset_remv(thread);
+	wheel_remv(thread);
+
+	thread->eax = source;
+	thread->ebx = id;
+
+	schedule_push(thread);
+	thread->state = TS_QUEUED;
+
+	return 0;
+}
+
+/*****************************************************************************
+ * waitset_wait
+ *
+ * Wait for any of the events in the 256-bit bitmap <set->events> or, with 
+ * the KWAIT_DEAD and KWAIT_FAULT flags, a dead or faulted thread. If a 
+ * source is already pending (an IRQ that has fired but not been reset, or a
+ * thread in the dead or fault queue), the thread's eax and ebx are set to 
+ * the result at once; otherwise the thread is put into the TS_WAITING state
+ * until a source fires. Returns nonzero if the wait set could not be allocated.
+ */
+
+int waitset_wait(struct thread *thread, const struct k_waitset *set) {
+	uint32_t flags = set->flags;
+	struct thread *ready;
+	int count = 0;
+
+	/* return at once if a selected source is pending */
+	for (int i = 0; i < EV_COUNT / 32; i++) {
+		uint32_t bits = set->events[i];
+
+		while (bits) {
+			int event = i * 32 + __builtin_ctz(bits);
+			bits &= bits - 1;
+
+			if (irq_ready(event)) {
+				thread->eax = event;
+				thread->ebx = irq_take(event);
+				return 0;
+			}
+
+			count++;
+		}
+	}
+
+	if ((flags & KWAIT_DEAD) && (ready = dead_pull())) {
+		thread->eax = KWAIT_SRC_DEAD;
+		thread->ebx = ready->id;
+		return 0;
+	}
+
+	if ((flags & KWAIT_FAULT) && (ready = fault_pull())) {
+		thread->eax = KWAIT_SRC_FAULT;
+		thread->ebx = ready->id;
+		return 0;
+	}
+
+	if (flags & KWAIT_DEAD)  count++;
+	if (flags & KWAIT_FAULT) count++;
+
+	if (!count) {
+		thread->eax = KWAIT_SRC_NONE;
+		return 0;
+	}
+
+	/* (re)allocate links */
+	if (count > thread->wait_size) {
+		struct wait_link *links = heap_alloc(count * sizeof(struct wait_link));
+
+		if (!links) {
+			thread->eax = KWAIT_SRC_NONE;
+			return 1;
+		}
+
+		if (thread->wait_links) {
+			heap_free(thread->wait_links, thread->wait_size * sizeof(struct wait_link));
+		}
+		thread->wait_links = links;
+		thread->wait_size = count;
+	}
+
+	/* link thread into every selected source */
+	struct wait_link *link = thread->wait_links;
+
+	for (int event = 0; event < EV_COUNT; event++) {
+		if (set->events[event / 32] & (1U << (event % 32))) {
+			link->thread = thread;
+			wait_list_add(&evqueue[event].sets, link++);
+		}
+	}
+
+	if (flags & KWAIT_DEAD) {
+		link->thread = thread;
+		wait_list_add(&dead_sets, link++);
+	}
+
+	if (flags & KWAIT_FAULT) {
+		link->thread = thread;
+		wait_list_add(&fault_sets, link++);
+	}
+
+	thread->wait_count = count;
+	thread->event = -1;
+
+	thread_save(thread);
+	thread->state = TS_WAITING;
+
+	return 0;
+}
+
+/*****************************************************************************
+ * waitset_remv
+ *
+ * Unlink a thread from all sources of its wait set, if it is waiting on one.
+ * Returns nonzero if the thread was not in a wait set.
+ */
+
+int waitset_remv(struct thread *thread) {
+
+	if (!thread->wait_count) {
+		return 1;
+	}
+
+	for (int i = 0; i < thread->wait_count; i++) {
+		wait_list_remv(&thread->wait_links[i]);
+	}
+	thread->wait_count = 0;
+
+	return 0;
+}
+
+/* event rings **************************************************************/
+
+/*****************************************************************************
+ * Event rings
+ *
+ * A thread's event ring is a page of its own memory, which the kernel also
+ * maps (writable) at one of EVRING_MAX slots from EVRING_KADDR, so that it
+ * can append records to it from event_send() in any paging context. The 
+ * kernel holds a reference to the ring's frame while it is mapped, and 
+ * never trusts the indices in it: the tail it writes is its own copy, and 
+ * the head only decides whether the ring is full or empty.
+ */
+
+static struct thread *_evring_owner[EVRING_MAX];
+
+/*****************************************************************************
+ * evring_ack
+ *
+ * Reset the one-shot IRQs whose bits the thread has set in the ack bitmap 
+ * of its ring, clearing the bits.
+ */
+
+static void evring_ack(struct k_evring *ring) {
+
+	for (int i = 0; i < EV_COUNT / 32; i++) {
+		uint32_t bits;
+
+		if (!ring->ack[i]) {
+			continue;
+		}
+
+		bits = __sync_lock_test_and_set(&ring->ack[i], 0);
+
+		while (bits) {
+			int irq = i * 32 + __builtin_ctz(bits);
+			bits &= bits - 1;
+
+			if (irq > 0 && irq < IRQ_INT_SIZE && !irq_counting(irq)) {
+				irqstate[irq] = 0;
+				irq_unmask(irq);
+			}
+		}
+	}
+}
+
+/*****************************************************************************
+ * evring_post
+ *
+ * Append a record of <count> firings of <event> to a thread's event ring,
+ * waking the thread if it is blocked in evring_wait().
+ */
+
+static void evring_post(struct thread *thread, int event, int count) {
+	struct k_evring *ring = thread->evring;
+	struct k_evrec *rec;
+
+	evring_ack(ring);
+
+	if (thread->evring_tail - ring->head >= KEVRING_SIZE) {
+		ring->lost++;
+	}
+	else {
+		rec = &ring->rec[thread->evring_tail & (KEVRING_SIZE - 1)];
+		rec->event = event;
+		rec->count = count;
+		rec->clock = timer_clock();
+
+		/* publish the record only once it is complete */
+		__asm__ volatile ("" : : : "memory");
+		ring->tail = ++thread->evring_tail;
+	}
+
+	if (thread->evring_wait) {
+		thread->evring_wait = 0;
+		wheel_remv(thread);
+
+		thread->eax = thread->evring_tail - ring->head;
+
+		schedule_push(thread);
+		thread->state = TS_QUEUED;
+	}
+}
+
+/*****************************************************************************
+ * evring_set
+ *
+ * Give a thread an event ring at <base> (a page in its paging context, which
+ * must be the current one) receiving the events in <set>, replacing any ring
+ * it had. If <base> is zero, the thread is left without a ring. Returns zero
+ * on success, or a TE_* error code.
+ */
+
+int evring_set(struct thread *thread, uintptr_t base, const struct k_waitset *set) {
+	struct k_evring *ring;
+	frame_t page;
+	int slot;
+
+	evring_free(thread);
+
+	if (!base) {
+		return 0;
+	}
+
+	if ((base & (PAGESZ - 1)) || base >= KERNEL_ADDR_BASE) {
+		return TE_PARAM;
+	}
+
+	page = page_get(base);
+	if ((page & (PF_PRES | PF_RW)) != (PF_PRES | PF_RW)) {
+		return TE_PARAM;
+	}
+
+	for (int event = 0; event < EV_COUNT; event++) {
+		if ((set->events[event / 32] & (1U << (event % 32))) && evqueue[event].ring) {
+			return TE_EXIST;
+		}
+	}
+
+	for (slot = 0; slot < EVRING_MAX && _evring_owner[slot]; slot++);
+	if (slot == EVRING_MAX) {
+		return TE_RESRC;
+	}
+
+	/* map the ring's frame for the kernel */
+	frame_ref(page_ufmt(page));
+	page_set(EVRING_KADDR + slot * PAGESZ, page_fmt(page_ufmt(page), PF_PRES | PF_RW));
+
+	ring = (void*) (EVRING_KADDR + slot * PAGESZ);
+	memclr(ring, offsetof(struct k_evring, rec));
+	ring->mask = KEVRING_SIZE - 1;
+
+	_evring_owner[slot] = thread;
+	thread->evring = ring;
+	thread->evring_tail = 0;
+	thread->evring_slot = slot;
+
+	/* route the selected events to it */
+	for (int event = 0; event < EV_COUNT; event++) {
+		if (set->events[event / 32] & (1U << (event % 32))) {
+			evqueue[event].ring = thread;
+		}
+	}
+
+	return 0;
+}
+
+/*****************************************************************************
+ * evring_free
+ *
+ * Stop delivering events to a thread's event ring, if it has one, and unmap
+ * the kernel's mapping of it.
+ */
+
+void evring_free(struct thread *thread) {
+	uintptr_t kaddr;
+	frame_t frame;
+
+	if (!thread->evring) {
+		return;
+	}
+
+	for (int event = 0; event < EV_COUNT; event++) {
+		if (evqueue[event].ring == thread) {
+			evqueue[event].ring = NULL;
+		}
+	}
+
+	kaddr = EVRING_KADDR + thread->evring_slot * PAGESZ;
+	frame = page_ufmt(page_get(kaddr));
+
+	page_set(kaddr, 0);
+	smp_flush_tlb(-1);
+	frame_free(frame);
+
+	_evring_owner[thread->evring_slot] = NULL;
+	thread->evring = NULL;
+}
+
+/*****************************************************************************
+ * evring_wait
+ *
+ * Reset the IRQs acknowledged in a thread's event ring, then return the 
+ * number of records in it (in the thread's eax) at once if it is not empty,
+ * or else put the thread into the TS_WAITING state until a record arrives.
+ * Returns nonzero if the thread has no event ring.
+ */
+
+int evring_wait(struct thread *thread) {
+	struct k_evring *ring = thread->evring;
+
+	if (!ring) {
+		return 1;
+	}
+
+	evring_ack(ring);
+
+	thread->eax = thread->evring_tail - ring->head;
+
+	if (!thread->eax) {
+		thread->evring_wait = 1;
+		thread->event = -1;
+
+		thread_save(thread);
+		thread->state = TS_WAITING;
+	}
+
+	return 0;
+}
+
+/*****************************************************************************
+ * evring_remv
+ *
+ * Stop a thread from waiting in evring_wait(). Returns nonzero if it was not
+ * waiting there.
+ */
+
+int evring_remv(struct thread *thread) {
+
+	if (!thread->evring_wait) {
+		return 1;
+	}
+
+	thread->evring_wait = 0;
+
+	return 0;
+}
+
+/* timer wheel **************************************************************/
+
+#define WHEEL_SHIFT  10 // clock ticks per wheel tick (2^10, just under 1 ms)
+#define WHEEL_BITS   6
+#define WHEEL_SIZE   (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+
+/*****************************************************************************
+ * wheel, wheel_map, wheel_tick, wheel_count
+ *
+ * Hierarchical timer wheel of threads blocked with a timeout. Level 0 has 
+ * one slot per wheel tick; each slot of level n covers a full rotation of 
+ * level n - 1, and its threads are redistributed to lower levels ("cascaded")
+ * when level n - 1 wraps around to that slot. Every armed timer is moved at 
+ * most WHEEL_LEVELS times, so expiry is amortized O(1) per timer.
+ *
+ * wheel_map has a bit set for each nonempty slot, which lets idle stretches
+ * be skipped without visiting every tick. wheel_tick is the next wheel tick
+ * to be processed, and wheel_count the number of armed timers.
+ */
+
+static struct thread *wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static uint64_t wheel_map[WHEEL_LEVELS];
+static uint64_t wheel_tick;
+static int wheel_count;
+
+static void wheel_insert(struct thread *thread) {
+	uint64_t expiry, delta;
+	int level, index;
+
+	expiry = (thread->timer_expiry + (1 << WHEEL_SHIFT) - 1) >> WHEEL_SHIFT;
+	if (expiry < wheel_tick) {
+		expiry = wheel_tick;
+	}
+
+	delta = expiry - wheel_tick;
+	for (level = 0; level < WHEEL_LEVELS - 1; level++) {
+		if (delta < (1ULL << (WHEEL_BITS * (level + 1)))) {
+			break;
+		}
+	}
+
+	if (delta >= (1ULL << (WHEEL_BITS * WHEEL_LEVELS))) {
+		/* beyond the range of the wheel: park in the furthest slot */
+		expiry = wheel_tick + (1ULL << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+	}
+
+	index = (expiry >> (WHEEL_BITS * level)) & (WHEEL_SIZE - 1);
+
+	thread->timer_slot = level * WHEEL_SIZE + index + 1;
+	thread->prev_timer = NULL;
+	thread->next_timer = wheel[level][index];
+	if (thread->next_timer) {
+		thread->next_timer->prev_timer = thread;
+	}
+	wheel[level][index] = thread;
+	wheel_map[level] |= 1ULL << index;
+}
+
+static void wheel_unlink(struct thread *thread) {
+	int level = (thread->timer_slot - 1) / WHEEL_SIZE;
+	int index = (thread->timer_slot - 1) % WHEEL_SIZE;
+
+	if (thread->prev_timer) {
+		thread->prev_timer->next_timer = thread->next_timer;
+	}
+	else {
+		wheel[level][index] = thread->next_timer;
+		if (!thread->next_timer) {
+			wheel_map[level] &= ~(1ULL << index);
+		}
+	}
+	if (thread->next_timer) {
+		thread->next_timer->prev_timer = thread->prev_timer;
+	}
+
+	thread->timer_slot = 0;
+}
+
+/*****************************************************************************
+ * wheel_add
+ *
+ * Arm a timer for the given blocked thread that wakes it at clock time 
+ * <expiry>. If the thread is waiting on an event when the timer fires, it 
+ * is removed from the event queue and its wait returns -1; otherwise it is
+ * simply woken with a return value of zero.
+ */
+
+void wheel_add(struct thread *thread, uint64_t expiry) {
+
+	if (thread->timer_slot) {
+		wheel_remv(thread);
+	}
+	else if (!wheel_count) {
+		/* the wheel is not run while empty, so catch up */
+		wheel_tick = timer_clock() >> WHEEL_SHIFT;
+	}
+
+	thread->timer_expiry = expiry;
+	wheel_insert(thread);
+	wheel_count++;
+
+	/* the BSP owns the tickless timer and must re-arm it */
+	if (cpu_get()->id) {
+		smp_kick(cpu_lookup(0));
+	}
+}
+
+/*****************************************************************************
+ * wheel_remv
+ *
+ * Disarm the given thread's timer without waking it. Returns zero on 
+ * success, nonzero if it had no timer armed.
+ */
+
+int wheel_remv(struct thread *thread) {
+
+	if (!thread->timer_slot) {
+		return 1;
+	}
+
+	wheel_unlink(thread);
+	wheel_count--;
+
+	return 0;
+}
+
+/*****************************************************************************
+ * wheel_next_tick
+ *
+ * Returns the first wheel tick at or after wheel_tick at which a nonempty
+ * slot is expired or cascaded. Must only be called if wheel_count is 
+ * nonzero.
+ */
+
+static uint64_t wheel_next_tick(void) {
+	uint64_t next = 0;
+
+	for (int level = 0; level < WHEEL_LEVELS; level++) {
+		uint64_t map, base, tick;
+		int shift = WHEEL_BITS * level;
+		int rot;
+
+		if (!wheel_map[level]) {
+			continue;
+		}
+
+		/* first rotation of this level not yet reached */
+		base = (wheel_tick + (1ULL << shift) - 1) >> shift;
+		rot  = base & (WHEEL_SIZE - 1);
+
+		map = wheel_map[level];
+		if (rot) map = (map >> rot) | (map << (WHEEL_SIZE - rot));
+
+		tick = (base + __builtin_ctzll(map)) << shift;
+		if (!next || tick < next) next = tick;
+	}
+
+	return next;
+}
+
+/*****************************************************************************
+ * wheel_next
+ *
+ * Returns the clock time at which wheel_run() next has work to do, or zero
+ * if no timers are armed.
+ */
+
+uint64_t wheel_next(void) {
+
+	if (!wheel_count) {
+		return 0;
+	}
+
+	return wheel_next_tick() << WHEEL_SHIFT;
+}
+
+/*****************************************************************************
+ * wheel_run
+ *
+ * Process the timer wheel up to clock time <now>, cascading timers and 
+ * waking the threads whose timers have expired. Ticks on which no slot 
+ * needs attention are skipped.
+ */
+
+void wheel_run(uint64_t now) {
+	uint64_t target = now >> WHEEL_SHIFT;
+	struct thread *t;
+
+	while (wheel_count) {
+		uint64_t tick = wheel_next_tick();
+		int index;
+
+		if (tick > target) {
+			break;
+		}
+		wheel_tick = tick;
+
+		/* cascade higher levels whose lower level wrapped around */
+		for (int level = 1; level < WHEEL_LEVELS; level++) {
+			if (tick & ((1ULL << (WHEEL_BITS * level)) - 1)) {
+				break;
+			}
+
+			index = (tick >> (WHEEL_BITS * level)) & (WHEEL_SIZE - 1);
+			while ((t = wheel[level][index])) {
+				wheel_unlink(t);
+				wheel_insert(t);
+			}
+		}
+
+		/* expire level 0 */
+		index = tick & (WHEEL_SIZE - 1);
+		while ((t = wheel[0][index])) {
+			wheel_unlink(t);
+			wheel_count--;
+
+			if (t->event >= 0) {
+				/* timed out waiting for an event */
+				event_remv(t->id, t->event);
+				t->eax = -1;
+
+				/* deliver a counting IRQ's count short of its threshold */
+				if (irq_counting(t->event) && irqstate[t->event]) {
+					t->eax = irq_take(t->event);
+				}
+			}
+			else if (!waitset_remv(t)) {
+				/* timed out waiting on a wait set */
+				t->eax = KWAIT_SRC_NONE;
+			}
+			else {
+				evring_remv(t);
+				t->eax = 0;
+			}
+			t->event = -1;
+
+			schedule_push(t);
+			t->state = TS_QUEUED;
+		}
+
+		wheel_tick = tick + 1;
+	}
+
+	if (wheel_tick <= target) {
+		wheel_tick = target + 1;
+	}
+}
+
+/* futex queues *************************************************************/
+
+#define FUTEX_HASH 64
+
+/*****************************************************************************
+ * futex_queue
+ *
+ * Hash table of FIFO queues of threads blocked in futex_wait(), keyed by
+ * paging context and virtual address. Addresses in the system region are
+ * mapped the same way in every paging context, so they are keyed with a
+ * paging context of -1.
+ */
+
+static struct futex_queue {
+	struct thread *head;
+	struct thread *tail;
+} futex_queue[FUTEX_HASH];
+
+static int futex_key(struct thread *thread, uint32_t addr) {
+	return (addr >= SYSTEM_ADDR_BASE) ? -1 : thread->pctx;
+}
+
+static struct futex_queue *futex_hash(int pctx, uint32_t addr) {
+	return &futex_queue[(((addr >> 2) + pctx) * 2654435761U) >> 26];
+}
+
+/*****************************************************************************
+ * futex_wait
+ *
+ * Block the given running thread on the futex at <addr> if the 32-bit word
+ * there (in the thread's address space) still equals <value>. The check and
+ * the block are atomic with respect to futex_wake(). Returns zero if the 
+ * thread blocked, TE_AGAIN if the value had changed, or TE_PARAM if <addr> 
+ * is misaligned or unmapped.
+ */
+
+int futex_wait(struct thread *thread, uint32_t addr, uint32_t value) {
+	struct futex_queue *queue;
+
+	if ((addr & 3) || addr >= KERNEL_ADDR_BASE || !(page_get(addr) & PF_PRES)) {
+		return TE_PARAM;
+	}
+
+	if (*((volatile uint32_t*) addr) != value) {
+		return TE_AGAIN;
+	}
+
+	thread->futex_pctx = futex_key(thread, addr);
+	thread->futex_addr = addr;
+	thread->next_futex = NULL;
+
+	queue = futex_hash(thread->futex_pctx, addr);
+	if (queue->tail) {
+		queue->tail->next_futex = thread;
+	}
+	else {
+		queue->head = thread;
+	}
+	queue->tail = thread;
+
+	thread_save(thread);
+	thread->state = TS_WAITING;
+	thread->event = -1;
+
+	return 0;
+}
+
+/*****************************************************************************
+ * futex_wake
+ *
+ * Wake up to <count> threads (in FIFO order) blocked on the futex at <addr>
+ * in the given thread's address space. Returns the number of threads woken.
+ */
+
+int futex_wake(struct thread *thread, uint32_t addr, int count) {
+	struct futex_queue *queue;
+	struct thread *t, *prev, *next;
+	int pctx = futex_key(thread, addr);
+	int woken = 0;
+
+	queue = futex_hash(pctx, addr);
+
+	prev = NULL;
+	for (t = queue->head; t && woken < count; t = next) {
+		next = t->next_futex;
+
+		if (t->futex_addr != addr || t->futex_pctx != pctx) {
+			prev = t;
+			continue;
+		}
+
+		/* unlink */
+		if (prev) prev->next_futex = next;
+		else queue->head = next;
+		if (queue->tail == t) queue->tail = prev;
+
+		t->futex_addr = 0;
+		t->eax = 0;
+		schedule_push(t);
+		t->state = TS_QUEUED;
+		woken++;
+	}
+
+	return woken;
+}
+
+/*****************************************************************************
+ * futex_remv
+ *
+ * Remove a thread from the futex queue it is blocked in, without waking it.
+ * Returns zero on success, nonzero if it is not blocked on a futex.
+ */
+
+int futex_remv(struct thread *thread) {
+	struct futex_queue *queue;
+	struct thread *t, *prev;
+
+	if (!thread->futex_addr) {
+		return 1;
+	}
+
+	queue = futex_hash(thread->futex_pctx, thread->futex_addr);
+
+	prev = NULL;
+	for (t = queue->head; t; prev = t, t = t->next_futex) {
+		if (t == thread) {
+			if (prev) prev->next_futex = t->next_futex;
+			else queue->head = t->next_futex;
+			if (queue->tail == t) queue->tail = prev;
+
+			thread->futex_addr = 0;
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* dead queue ***************************************************************/
+
+static struct thread *dead_tail;
+static struct thread *dead_head;
+
+static struct thread *reaper_tail;
+static struct thread *reaper_head;
+
+int dead_push(struct thread *thread) {
+
+	if (reaper_tail) {
+
+		// retrieve next reaper
+		struct thread *reaper;
+		reaper = reaper_tail;
+		reaper_tail = reaper_tail->next_dead;
+		if (!reaper_tail) {
+			reaper_head = NULL;
+		}
 
 		// notify reaper
 		reaper->eax = thread->id;
@@ -368,6 +1690,10 @@ int dead_push(struct thread *thread) {
 		return 0;
 	}
 
+	if (!wait_list_wake(&dead_sets, KWAIT_SRC_DEAD, thread->id)) {
+		return 0;
+	}
+
 	if (dead_head) {
 		dead_head->next_dead = thread;
 		thread->next_dead = NULL;
@@ -458,6 +1784,10 @@ int fault_push(struct thread *fault) {
 		return 0;
 	}
 
+	if (!wait_list_wake(&fault_sets, KWAIT_SRC_FAULT, fault->id)) {
+		return 0;
+	}
+
 	if (fault_head) {
 		fault_head->next_fault = fault;
 		fault->next_fault = NULL;
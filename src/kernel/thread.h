@@ -67,21 +67,71 @@ struct thread {
 	uint32_t usr_eip;
 	uint32_t usr_esp;
 
-	uint32_t *fxdata;
+	uint32_t tls_base; // base of the TLS segment (FS) for this thread
+
+	uint32_t *fxdata; // FPU/SSE state, allocated on first use
+	uint32_t *fxcache; // save area left by a previous user of this structure
+	int fpu_cpu;      // processor with this state in its registers, plus one
 
 	/* thread state */
 	int id;
 	int state;
 	uint8_t flags;
+	int cpu; // processor the thread last ran on
+	struct thread *pauser; // thread waiting for this one to stop running
 
 	/* scheduler information */
 	uint64_t tick;
+	int8_t sched_priority;
+	uint8_t sched_flags;
+	uint64_t sched_stamp;
+	uint64_t vruntime;
 	struct thread *next;
+	struct thread *prev;
+
+	/* deadline class information */
+	uint32_t dl_period;
+	uint32_t dl_budget;
+	uint32_t dl_deadline;
+	uint32_t dl_misses;
+	int64_t  dl_runtime;
+	uint64_t dl_abs;
+	uint8_t  dl_throttled;
+	uint8_t  dl_yield;
+
+	/* scheduler heap information */
+	uint64_t heap_key;
+	struct thread *heap_child;
+	struct thread *heap_next;
+	struct thread *heap_prev;
 
 	/* event queue information */
 	int event;
 	struct thread *next_evqueue;
 
+	/* wait set information */
+	struct wait_link *wait_links; // links into source lists, kept for reuse
+	int wait_count; // number of linked sources, or zero if not in a wait set
+	int wait_size;  // capacity of wait_links
+
+	/* event ring information */
+	struct k_evring *evring; // kernel mapping of the ring, or NULL
+	uint32_t evring_tail;    // kernel copy of the ring's tail
+	int evring_slot;
+	uint8_t evring_wait;     // blocked in evring_wait()
+
+	/* timer wheel information */
+	uint64_t timer_expiry;
+	int timer_slot; // wheel slot + 1, or zero if no timer is armed
+	uint8_t timer_paused; // timer_expiry to be re-armed when resumed
+	struct thread *next_timer;
+	struct thread *prev_timer;
+
+	/* futex queue information */
+	int futex_pctx;
+	uint32_t futex_addr;
+	struct thread *next_futex;
+
 	/* dead queue information */
 	struct thread *next_dead;
 
@@ -93,6 +143,11 @@ struct thread {
 	/* paging context */
 	int pctx;
 
+	/* resource usage */
+	struct t_usage usage;
+	struct t_usage usage_base;
+	uint64_t usage_stamp;
+
 } __attribute__ ((packed));
 
 /* thread operations *******************************************************/
@@ -103,20 +158,81 @@ void           thread_kill(struct thread *image);
 
 int thread_save(struct thread *thread);
 int thread_load(struct thread *thread);
+int thread_preempt(struct thread *thread);
+int thread_preempt_front(struct thread *thread);
 
 int thread_new(void);
+int thread_count(void);
+int thread_limit(void);
 
 /* scheduler ****************************************************************/
 
 int            schedule_push(struct thread *thread);
+int            schedule_push_front(struct thread *thread);
 int            schedule_remv(struct thread *thread);
 struct thread *schedule_next(void);
+int            schedule_preempt(struct thread *thread);
+int            schedule_throttled(struct thread *thread);
+int            schedule_handoff(struct thread *active, struct thread *thread);
+int            schedule_tick(struct thread *thread);
+void           schedule_start(struct thread *thread);
+void           schedule_stop(struct thread *thread);
+void           schedule_yield(struct thread *thread);
+int            schedule_clock(struct thread *active, uint64_t now);
+uint64_t       schedule_timer(struct thread *active);
+int            schedule_setdl(struct thread *thread, uint32_t period, 
+                              uint32_t budget, uint32_t deadline);
+
+/* lazy FPU state ***********************************************************/
+
+void fpu_take(struct thread *thread);
+void fpu_drop(struct thread *thread);
+void fpu_get_state(struct thread *thread, void *fxdata);
+void fpu_set_state(struct thread *thread, const void *fxdata);
+
+/* resource usage ***********************************************************/
+
+void thread_retire_usage(struct thread *thread);
+int  pctx_get_usage(int pctx, struct t_usage *usage);
 
 /* event queue **************************************************************/
 
 int event_wait(int thread, int event);
 int event_remv(int thread, int event);
 int event_send(int thread, int event);
+int event_waiting(int event);
+struct thread *event_front(int event);
+
+int event_setmode(int event, int wake);
+int irq_setmode(int irq, int flags, int threshold);
+
+/* wait sets ****************************************************************/
+
+int waitset_wait(struct thread *thread, const struct k_waitset *set);
+int waitset_remv(struct thread *thread);
+
+/* event rings **************************************************************/
+
+#define EVRING_KADDR 0xFF100000 // writable kernel mappings of event rings
+#define EVRING_MAX   256        // number of event rings that can be mapped
+
+int  evring_set (struct thread *thread, uintptr_t base, const struct k_waitset *set);
+void evring_free(struct thread *thread);
+int  evring_wait(struct thread *thread);
+int  evring_remv(struct thread *thread);
+
+/* timer wheel **************************************************************/
+
+void     wheel_add (struct thread *thread, uint64_t expiry);
+int      wheel_remv(struct thread *thread);
+void     wheel_run (uint64_t now);
+uint64_t wheel_next(void);
+
+/* futex queues *************************************************************/
+
+int futex_wait(struct thread *thread, uint32_t addr, uint32_t value);
+int futex_wake(struct thread *thread, uint32_t addr, int count);
+int futex_remv(struct thread *thread);
 
 /* dead/reaper queue ********************************************************/
 
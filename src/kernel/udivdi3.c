@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2012 Nick Johnson <nickbjohnson4224 at gmail.com>
+ * 
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*****************************************************************************
+ * __udivdi3, __umoddi3
+ *
+ * 64-bit unsigned division and modulus. GCC emits calls to these for 64-bit
+ * division on 32-bit x86, and the kernel is not linked against libgcc. These
+ * are slow (one iteration per bit), so keep 64-bit division out of hot paths.
+ */
+
+uint64_t __udivdi3(uint64_t n, uint64_t d);
+uint64_t __umoddi3(uint64_t n, uint64_t d);
+
+static uint64_t udivmod(uint64_t n, uint64_t d, uint64_t *rem) {
+	uint64_t q = 0;
+	uint64_t r = 0;
+
+	for (int i = 63; i >= 0; i--) {
+		r = (r << 1) | ((n >> i) & 1);
+		if (r >= d) {
+			r -= d;
+			q |= 1ULL << i;
+		}
+	}
+
+	if (rem) *rem = r;
+	return q;
+}
+
+uint64_t __udivdi3(uint64_t n, uint64_t d) {
+	return udivmod(n, d, NULL);
+}
+
+uint64_t __umoddi3(uint64_t n, uint64_t d) {
+	uint64_t r;
+
+	udivmod(n, d, &r);
+	return r;
+}
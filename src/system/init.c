@@ -24,8 +24,7 @@
 
 uint32_t stack[65536];
 
-int t_reaper;
-int t_debugger;
+int t_supervisor;
 
 void func0(void) {
 	log(VERBOSE, "func0 on thread %d", __t_getid());
@@ -37,13 +36,19 @@ void func1(void) {
 	for(;;);
 }
 
-void debugger(void) {
+void supervisor(void) {
+	struct k_waitset set = { .flags = KWAIT_DEAD | KWAIT_FAULT };
 	struct t_info info;
 	
-	log(INIT, "debugger starting on thread %d", __t_getid());
+	log(INIT, "supervisor starting on thread %d", __t_getid());
 
 	while (1) {
-		int thread = __t_getfault();
+		int thread;
+
+		if (__t_waitset(&set, 0, &thread) == KWAIT_SRC_DEAD) {
+			__t_reap(thread, (void*) 0);
+			continue;
+		}
 
 		__t_getstate(thread, &info);
 
@@ -67,16 +72,6 @@ void debugger(void) {
 	}
 }
 
-void reaper(void) {
-	log(INIT, "reaper starting on thread %d", __t_getid());
-
-	while (1) {
-		int thread = __t_getdead();
-
-		__t_reap(thread, (void*) 0);
-	}
-}
-
 #define ALT  0x00800000
 #define CTRL 0x00800001
 #define SHFT 0x00800002
@@ -155,19 +150,31 @@ const int keymap[4][128] = {
 	}
 };
 
+#define KBD_EVRING 0xD1000000
+
 void keyboard(void) {
 
 	static bool shift = false;
 	static bool caps  = false;
 	static bool numlk = false;
+
+	struct k_evring *ring = (void*) KBD_EVRING;
+	struct k_waitset set = { .events = { 1 << 1 } };
+	struct k_evrec rec;
+
+	__t_setsched(-1, SP_MAX, SF_FIXED);
+
+	// take IRQ 1 through an event ring: one kernel entry per idle period
+	p_alloc(KBD_EVRING, PFLAG_PRES | PFLAG_WRITE);
+	__ev_ring(ring, &set);
 	
 	while (1) {
-		__irq_wait(1);
+		ev_ring_next(ring, &rec);
 
 		extern uint8_t inb(uint16_t port);
 		uint8_t scan = inb(0x60) & 0xFF;
 
-		__irq_reset(1);
+		ev_ring_ack(ring, 1);
 
 		if (scan == 0xE0) continue;
 		int code = keymap[((shift ^ caps) ? 2 : 0) | ((numlk) ? 1 : 0)][scan & ~0x80];
@@ -192,24 +199,266 @@ void keyboard(void) {
 	}
 }
 
+#define PERIODIC_CHECK_JOBS 500 // jobs before the pass/fail line (5 s)
+
+void periodic(void) {
+	struct t_usage usage;
+	struct t_dl dl;
+	uint32_t job;
+
+	// 2 ms of work every 10 ms
+	dl.period   = 10000;
+	dl.budget   = 2000;
+	dl.deadline = 0;
+
+	if (__t_setdl(-1, &dl)) {
+		log(ERROR, "periodic: deadline reservation refused");
+		return;
+	}
+
+	log(INIT, "periodic starting on thread %d", __t_getid());
+
+	for (job = 1;; job++) {
+
+		// simulate roughly 1 ms of work
+		for (volatile int i = 0; i < 100000; i++);
+
+		__t_yield();
+
+		if (job % 500 == 0) {
+			__t_getdl(-1, &dl);
+			log(VERBOSE, "periodic: %d jobs, %d deadline misses", job, dl.misses);
+
+			// result checked by test/run.sh
+			if (job == PERIODIC_CHECK_JOBS) {
+				log(INIT, "periodic: %s, %d deadline misses in %d jobs",
+					dl.misses ? "FAIL" : "PASS", dl.misses, job);
+			}
+
+			__t_getusage(-1, &usage);
+			log(VERBOSE, "periodic: %d Mcycles run, %d Mcycles kernel, %d/%d switches",
+				(int) (usage.run_cycles >> 20), (int) (usage.kernel_cycles >> 20),
+				usage.vswitches, usage.iswitches);
+		}
+	}
+}
+
+void sleeper(void) {
+	uint64_t start;
+	uint32_t late, total, worst;
+
+	log(INIT, "sleeper starting on thread %d", __t_getid());
+
+	while (1) {
+		total = worst = 0;
+
+		// 1000 sleeps of 3 ms; report how late the wakeups are
+		for (int i = 0; i < 1000; i++) {
+			start = __t_gettime();
+			__t_sleep(3000000);
+			late = (uint32_t) (__t_gettime() - start - 3000000) / 1000;
+
+			total += late;
+			if (late > worst) worst = late;
+		}
+
+		log(VERBOSE, "sleeper: wakeup latency %d us average, %d us worst",
+			total / 1000, worst);
+	}
+}
+
+/*****************************************************************************
+ * rtc_latency
+ *
+ * Measures IRQ-to-handler latency with the RTC periodic interrupt (IRQ 8) at
+ * 1024 Hz, competing for the processor with the busy fair-class thread 
+ * func1, first as an ordinary fair-class thread, then with SF_HANDOFF. The 
+ * IRQ is taken through an event ring, so the latency of each wakeup is 
+ * measured from the kernel's timestamp of the interrupt, however many RTC 
+ * ticks were missed while it was masked.
+ */
+
+#define RTC_SAMPLES 512
+#define RTC_EVRING  0xD2000000
+
+static void rtc_ack(void) {
+	extern void outb(uint16_t port, uint8_t value);
+	extern uint8_t inb(uint16_t port);
+
+	outb(0x70, 0x0C);
+	inb(0x71);
+}
+
+static void rtc_enable(bool enable) {
+	extern void outb(uint16_t port, uint8_t value);
+	extern uint8_t inb(uint16_t port);
+	uint8_t reg;
+
+	// rate 6 (1024 Hz)
+	outb(0x70, 0x8A);
+	reg = inb(0x71);
+	outb(0x70, 0x8A);
+	outb(0x71, (reg & 0xF0) | 6);
+
+	// periodic interrupt enable
+	outb(0x70, 0x8B);
+	reg = inb(0x71);
+	outb(0x70, 0x8B);
+	outb(0x71, (enable) ? (reg | 0x40) : (reg & ~0x40));
+
+	rtc_ack();
+}
+
+static uint64_t rtc_clock2ns(uint64_t clock) {
+	return (clock >> 20) * 1000000000 + (((clock & 0xFFFFF) * 1000000000) >> 20);
+}
+
+static void rtc_pass(struct k_evring *ring, const char *name) {
+	struct k_evrec rec;
+	int64_t delay;
+	uint32_t late, total = 0, worst = 0;
+
+	for (int i = 0; i < RTC_SAMPLES; i++) {
+		ev_ring_next(ring, &rec);
+		delay = (int64_t) (__t_gettime() - rtc_clock2ns(rec.clock));
+		rtc_ack();
+		ev_ring_ack(ring, 8);
+
+		late = (delay > 0) ? (uint32_t) delay / 1000 : 0;
+
+		total += late;
+		if (late > worst) worst = late;
+	}
+
+	log(VERBOSE, "rtc: %s IRQ latency %d us average, %d us worst",
+		name, total / RTC_SAMPLES, worst);
+}
+
+void rtc_latency(void) {
+
+	struct k_evring *ring = (void*) RTC_EVRING;
+	struct k_waitset set = { .events = { 1 << 8 } };
+
+	log(INIT, "rtc latency benchmark on thread %d", __t_getid());
+
+	p_alloc(RTC_EVRING, PFLAG_PRES | PFLAG_WRITE);
+	__ev_ring(ring, &set);
+
+	rtc_enable(true);
+
+	__t_setsched(-1, 0, 0);
+	rtc_pass(ring, "queued");
+
+	__t_setsched(-1, 0, SF_HANDOFF);
+	rtc_pass(ring, "handoff");
+
+	rtc_enable(false);
+	__t_exit(0);
+}
+
+void bench_getid(void) {
+	uint64_t start;
+	uint32_t slow, fast;
+
+	// thread ID by kernel call vs. from the kernel data page (in ps per call)
+	start = __t_gettime();
+	for (int i = 0; i < 10000; i++) kcall(KCALL_GETTID, 0, 0, 0, 0);
+	slow = (uint32_t) (__t_gettime() - start) / 10;
+
+	start = __t_gettime();
+	for (int i = 0; i < 10000; i++) __t_getid();
+	fast = (uint32_t) (__t_gettime() - start) / 10;
+
+	log(VERBOSE, "getid: %d ps by kcall, %d ps from kernel data page", slow, fast);
+}
+
+void bench_kcall(void) {
+	uint64_t start;
+	uint32_t slow, fast;
+
+	// kcall round trip through "int 0x81" vs. SYSENTER (in cycles per call)
+	start = rdtsc();
+	for (int i = 0; i < 10000; i++) kcall_int(KCALL_GETTID, 0, 0, 0, 0);
+	slow = (uint32_t) (rdtsc() - start) / 10000;
+
+	start = rdtsc();
+	for (int i = 0; i < 10000; i++) kcall(KCALL_GETTID, 0, 0, 0, 0);
+	fast = (uint32_t) (rdtsc() - start) / 10000;
+
+	log(VERBOSE, "kcall: %d cycles by int 0x81, %d cycles by %s", slow, fast,
+		(__t_getflags() & KDATA_F_SYSENTER) ? "SYSENTER" : "int 0x81 (no SYSENTER)");
+}
+
+void bench_map(void) {
+	struct t_usage before, after;
+	uint64_t start;
+	uint32_t time;
+	int count;
+
+	// map a 16 MB heap with one kcall
+	__t_getusage(-1, &before);
+	start = __t_gettime();
+	p_alloc_range(0xD0000000, 0x1000000, PFLAG_PRES | PFLAG_WRITE);
+	time = (uint32_t) (__t_gettime() - start) / 1000;
+	__t_getusage(-1, &after);
+
+	log(VERBOSE, "map: 16 MB in %d us with %d kernel entries", 
+		time, after.kcalls - before.kcalls - 1);
+
+	// write-protect it, then unmap and free it, one kcall each
+	start = __t_gettime();
+	p_protect(0xD0000000, 0x1000000, PFLAG_PRES);
+	time = (uint32_t) (__t_gettime() - start) / 1000;
+	log(VERBOSE, "protect: 16 MB in %d us", time);
+
+	start = __t_gettime();
+	count = p_unmap(0xD0000000, 0x1000000);
+	time = (uint32_t) (__t_gettime() - start) / 1000;
+	log(VERBOSE, "unmap: %d frames freed in %d us", count, time);
+}
+
 void init(void) {
+	struct k_info info;
 	struct t_info state;
 
 	__init_log();
 
 	log(INIT, "starting up");
 
-	state.regs.eip = (uintptr_t) debugger;
-	state.regs.esp = (uintptr_t) &stack[255];
-	t_debugger = __t_spawn(&state);
+	__kinfo(&info);
+	log(INIT, "%d processors, up to %d threads and %d paging contexts",
+		info.cpu_count, info.thread_limit, info.pctx_limit);
+
+	bench_getid();
+	bench_kcall();
+	bench_map();
+
+	syscall_init();
 
-	state.regs.eip = (uintptr_t) reaper;
+	state.regs.eip = (uintptr_t) supervisor;
 	state.regs.esp = (uintptr_t) &stack[511];
-	t_reaper = __t_spawn(&state);
+	t_supervisor = __t_spawn(&state);
 
 	state.regs.eip = (uintptr_t) keyboard;
 	state.regs.esp = (uintptr_t) &stack[65535];
 	__t_spawn(&state);
 
+	state.regs.eip = (uintptr_t) periodic;
+	state.regs.esp = (uintptr_t) &stack[32767];
+	__t_spawn(&state);
+
+	state.regs.eip = (uintptr_t) sleeper;
+	state.regs.esp = (uintptr_t) &stack[24575];
+	__t_spawn(&state);
+
+	state.regs.eip = (uintptr_t) rtc_latency;
+	state.regs.esp = (uintptr_t) &stack[40959];
+	__t_spawn(&state);
+
+	// background load for the periodic thread to compete with
+	state.regs.eip = (uintptr_t) func1;
+	state.regs.esp = (uintptr_t) &stack[16383];
+	__t_spawn(&state);
+
 	*((volatile int*) 42) = 24;
 }
@@ -14,9 +14,41 @@
 
 [bits 32]
 
+; kcall - make a kernel call, with SYSENTER if the kernel supports it
+
 global kcall
 kcall:
 	push ebx
+	push edi
+	push ebp
+
+	mov eax, [esp+16]
+	mov ebx, [esp+20]
+	mov ecx, [esp+24]
+	mov edx, [esp+28]
+
+	test dword [gs:36], 1 ; KDATA_FLAGS & KDATA_F_SYSENTER
+	jz .int
+
+	mov edi, .done
+	mov ebp, esp
+	sysenter
+
+	; the kernel restarts an interrupted SYSENTER kcall here (at .done - 2)
+.int:
+	int 0x81
+.done:
+
+	pop ebp
+	pop edi
+	pop ebx
+	ret
+
+; kcall_int - make a kernel call with "int 0x81" only
+
+global kcall_int
+kcall_int:
+	push ebx
 
 	mov eax, [esp+8]
 	mov ebx, [esp+12]
@@ -42,3 +74,25 @@ _wait:
 
 	pop ebx
 	ret
+
+; __t_waitset - wait on a set of sources, storing the thread ID from ebx
+
+global __t_waitset
+__t_waitset:
+	push ebx
+
+	mov eax, 0x34 ; KCALL_WAITSET
+	mov ebx, [esp+8]
+	mov ecx, [esp+12]
+	mov edx, [esp+16]
+
+	int 0x81
+
+	mov ecx, [esp+20]
+	test ecx, ecx
+	jz .done
+	mov [ecx], ebx
+.done:
+
+	pop ebx
+	ret
@@ -14,11 +14,34 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <config/address.h>
 #include <pinion.h>
 #include "kernel.h"
 
 extern int kcall(int call, int arg0, int arg1, int arg2, int arg3);
 
+/* kernel data page *********************************************************/
+
+static uint32_t kdata_read(uint32_t offset) {
+	uint32_t value;
+
+	__asm__ volatile ("movl %%gs:(%1), %0" : "=r" (value) : "r" (offset));
+
+	return value;
+}
+
+int __kinfo(struct k_info *info) {
+	return kcall(KCALL_KINFO, (int) info, 0, 0, 0);
+}
+
+uint64_t rdtsc(void) {
+	uint64_t value;
+
+	__asm__ volatile ("rdtsc" : "=A" (value));
+
+	return value;
+}
+
 int __t_spawn(struct t_info *state) {
 	return kcall(KCALL_SPAWN, (int) state, 0, 0, 0);
 }
@@ -58,18 +81,93 @@ int __t_kill(int thread, int status) {
 	return 0;
 }
 
+int __t_setsched(int thread, int priority, int flags) {
+	struct t_info state;
+	int err;
+
+	err = __t_getstate(thread, &state);
+	if (err) return err;
+
+	state.sched_priority = priority;
+	state.sched_flags = flags;
+
+	err = __t_setstate(thread, &state);
+	if (err) return err;
+
+	return 0;
+}
+
+int __t_setdl(int thread, struct t_dl *dl) {
+	return kcall(KCALL_SETDL, thread, (int) dl, 0, 0);
+}
+
+int __t_getdl(int thread, struct t_dl *dl) {
+	return kcall(KCALL_GETDL, thread, (int) dl, 0, 0);
+}
+
+int __t_getusage(int thread, struct t_usage *usage) {
+	return kcall(KCALL_GETUSAGE, thread, (int) usage, 0, 0);
+}
+
+int __futex_wait(volatile uint32_t *addr, uint32_t value) {
+	return kcall(KCALL_FUTEXWAIT, (int) addr, (int) value, 0, 0);
+}
+
+int __futex_wake(volatile uint32_t *addr, int count) {
+	return kcall(KCALL_FUTEXWAKE, (int) addr, count, 0, 0);
+}
+
+int __t_sleep(uint64_t ns) {
+	return kcall(KCALL_SLEEP, (int) ns, (int) (ns >> 32), 0, 0);
+}
+
+int __t_sleep_until(uint64_t ns) {
+	return kcall(KCALL_SLEEPUNTIL, (int) ns, (int) (ns >> 32), 0, 0);
+}
+
+uint64_t __t_gettime(void) {
+	uint64_t base, delta, clock;
+	uint32_t mult;
+
+	// computed from the kernel data page, the same way the kernel does
+	base  = kdata_read(KDATA_TSC_BASE);
+	base |= (uint64_t) kdata_read(KDATA_TSC_BASE + 4) << 32;
+	mult  = kdata_read(KDATA_TSC_MULT);
+	delta = rdtsc() - base;
+
+	clock = (delta >> 32) * mult + (((delta & 0xFFFFFFFF) * mult) >> 32);
+
+	return (clock >> 20) * 1000000000 + (((clock & 0xFFFFF) * 1000000000) >> 20);
+}
+
+int __t_setgate(void (*entry)(void)) {
+	return kcall(KCALL_SETGATE, (int) entry, 0, 0, 0);
+}
+
 int __t_reap(int thread, struct t_info *info) {
 	return kcall(KCALL_REAP, thread, (int) info, 0, 0);
 }
 
 int __t_getid(void) {
-	return kcall(KCALL_GETTID, 0, 0, 0, 0);
+	return kdata_read(KDATA_THREAD);
+}
+
+int __t_getcpu(void) {
+	return kdata_read(KDATA_CPU);
+}
+
+int __t_getflags(void) {
+	return kdata_read(KDATA_FLAGS);
 }
 
 int __t_yield(void) {
 	return kcall(KCALL_YIELD, 0, 0, 0, 0);
 }
 
+int __t_yield_to(int thread) {
+	return kcall(KCALL_YIELDTO, thread, 0, 0, 0);
+}
+
 int __t_pause(int thread) {
 	return kcall(KCALL_PAUSE, thread, 0, 0, 0);
 }
@@ -98,10 +196,22 @@ int __irq_wait(int irq) {
 	return kcall(KCALL_WAIT, irq, 0, 0, 0);
 }
 
+int __irq_wait_timeout(int irq, uint64_t ns) {
+	return kcall(KCALL_WAIT, irq, (int) ns, (int) (ns >> 32), 0);
+}
+
 int __irq_reset(int irq) {
 	return kcall(KCALL_RESET, irq, 0, 0, 0);
 }
 
+int __irq_mode(int irq, int flags, int threshold) {
+	return kcall(KCALL_IRQMODE, irq, flags, threshold, 0);
+}
+
+int __ev_mode(int event, int wake) {
+	return kcall(KCALL_EVMODE, event, wake, 0, 0);
+}
+
 int pctx_new(void) {
 	return kcall(KCALL_NEWPCTX, 0, 0, 0, 0);
 }
@@ -110,6 +220,10 @@ int pctx_free(int pctx) {
 	return kcall(KCALL_FREEPCTX, pctx, 0, 0, 0);
 }
 
+int pctx_usage(int pctx, struct t_usage *usage) {
+	return kcall(KCALL_PCTXUSAGE, pctx, (int) usage, 0, 0);
+}
+
 uint64_t newframe(void) {
 	return kcall(KCALL_NEWFRAME, 0, 0, 0, 0);
 }
@@ -122,17 +236,82 @@ int takeframe(uint64_t frame) {
 	return kcall(KCALL_TAKEFRAME, frame & 0xFFFFFFFF, frame >> 32ULL, 0, 0);
 }
 
-int p_alloc(uint32_t page, int flags) {
-	uint64_t frame = newframe();
+/*****************************************************************************
+ * kring_push
+ *
+ * Queue a kcall in the submission ring of <ring>. The ring must have room.
+ */
+
+static void kring_push(struct k_ring *ring, int call, uint32_t arg0, 
+		uint32_t arg1, int flags) {
+	struct k_sqe *sqe = &ring->sq[ring->sq_tail & ring->mask];
 
-	if (frame == 0xFFFFFFFFFFFFFFFFULL) return 1;
+	sqe->call  = call;
+	sqe->arg0  = arg0;
+	sqe->arg1  = arg1;
+	sqe->arg2  = 0;
+	sqe->flags = flags;
+	sqe->data  = 0;
 
-	p_set_frame(page, frame);
-	p_set_flags(page, flags);
+	ring->sq_tail++;
+}
+
+/*****************************************************************************
+ * kring_flush
+ *
+ * Run all queued kcalls in <ring> and discard their completions.
+ */
+
+static void kring_flush(struct k_ring *ring) {
+
+	while (ring->sq_head != ring->sq_tail) {
+		kcall(KCALL_BATCH, (int) ring, 0, 0, 0);
+		ring->cq_head = ring->cq_tail;
+	}
+}
+
+int p_alloc(uint32_t page, int flags) {
+	struct k_sqe sq[4];
+	struct k_cqe cq[4];
+	struct k_ring ring = { 0, 0, 0, 0, 3, sq, cq };
+
+	// allocate, map and set flags with one kernel entry
+	kring_push(&ring, KCALL_NEWFRAME, 0, 0, 0);
+	kring_push(&ring, KCALL_SETFRAME, page, 0, KSQE_PREV);
+	kring_push(&ring, KCALL_SETFLAGS, page, flags, 0);
+	kring_flush(&ring);
 
 	return 0;
 }
 
+/*****************************************************************************
+ * p_alloc_range, p_free_range
+ *
+ * Allocate fresh frames for the pages in [base, base + size) that are not
+ * yet present, with the given page flags; or unmap and free every frame in
+ * that range. Either way, it takes one kernel entry.
+ */
+
+int p_alloc_range(uint32_t base, uint32_t size, int flags) {
+	return kcall(KCALL_ALLOC, base, size / PAGESZ, flags, 0);
+}
+
+int p_free_range(uint32_t base, uint32_t size) {
+	return kcall(KCALL_FREE, base, size / PAGESZ, 0, 0);
+}
+
+int p_map(const struct k_mapping *map, int count) {
+	return kcall(KCALL_MAPV, (int) map, count, 0, 0);
+}
+
+int p_unmap(uint32_t base, uint32_t size) {
+	return kcall(KCALL_UNMAP, base, size / PAGESZ, 0, 0);
+}
+
+int p_protect(uint32_t base, uint32_t size, int flags) {
+	return kcall(KCALL_PROTECT, base, size / PAGESZ, flags, 0);
+}
+
 int p_set_frame(uint32_t page, uint64_t frame) {
 	return kcall(KCALL_SETFRAME, page, frame, 0, 0);
 }
@@ -148,3 +327,66 @@ uint64_t p_get_frame(uint32_t page) {
 int p_get_flags(uint32_t page) {
 	return kcall(KCALL_GETFLAGS, page, 0, 0, 0);
 }
+
+/* thread-local storage *****************************************************/
+
+uint32_t tls_read(uint32_t offset) {
+	uint32_t value;
+
+	__asm__ volatile ("movl %%fs:(%1), %0" : "=r" (value) : "r" (offset));
+
+	return value;
+}
+
+void tls_write(uint32_t offset, uint32_t value) {
+	__asm__ volatile ("movl %0, %%fs:(%1)" : : "r" (value), "r" (offset) : "memory");
+}
+
+int __t_settls(int thread, void *base) {
+	return kcall(KCALL_SETTLS, thread, (int) base, 0, 0);
+}
+
+void *__t_gettls(int thread) {
+	return (void*) kcall(KCALL_GETTLS, thread, 0, 0, 0);
+}
+
+/* event rings **************************************************************/
+
+int __ev_ring(struct k_evring *ring, struct k_waitset *set) {
+	return kcall(KCALL_EVRING, (int) ring, (int) set, 0, 0);
+}
+
+int __ev_ring_wait(uint64_t ns) {
+	return kcall(KCALL_EVRWAIT, (int) ns, (int) (ns >> 32), 0, 0);
+}
+
+/*****************************************************************************
+ * ev_ring_next
+ *
+ * Take the next record from an event ring, blocking in the kernel only if
+ * the ring is empty.
+ */
+
+void ev_ring_next(struct k_evring *ring, struct k_evrec *rec) {
+	volatile struct k_evring *vring = ring;
+
+	while (vring->head == vring->tail) {
+		__ev_ring_wait(0);
+	}
+
+	*rec = ring->rec[vring->head & (KEVRING_SIZE - 1)];
+	__asm__ volatile ("" : : : "memory");
+	vring->head++;
+}
+
+/*****************************************************************************
+ * ev_ring_ack
+ *
+ * Reset a one-shot IRQ delivered through an event ring. The kernel unmasks 
+ * it the next time it touches the ring, at the latest when the thread next
+ * blocks, so a run of acknowledgements costs no kcalls.
+ */
+
+void ev_ring_ack(struct k_evring *ring, int irq) {
+	__sync_fetch_and_or(&ring->ack[irq / 32], 1U << (irq % 32));
+}
@@ -23,23 +23,44 @@
 /* kernel call *************************************************************/
 
 int kcall(int call, int arg0, int arg1, int arg2, int arg3);
+int kcall_int(int call, int arg0, int arg1, int arg2, int arg3);
+
+uint64_t rdtsc(void);
+
+uint32_t tls_read (uint32_t offset);
+void     tls_write(uint32_t offset, uint32_t value);
 
 /* specific calls **********************************************************/
 
+int __kinfo(struct k_info *info);                   // get kernel limits
 int __t_spawn(struct t_info *state);				// spawn a new thread
 int __t_exit(int status);							// exit the current thread
 int __t_kill(int thread, int status);				// kill another thread
 int __t_reap(int thread, struct t_info *info);		// reap a zombie thread
 int __t_wait(int event, int *status);				// wait for an event
 int __t_getid(void);								// get the current thread ID
+int __t_getcpu(void);                               // get the current processor
+int __t_getflags(void);                             // get kernel data flags
 int __t_yield(void);								// yield thread timeslice
+int __t_yield_to(int thread);						// yield timeslice to a thread
 int __t_getdead(void);                              // get next dead thread ID
 int __t_getfault(void);                             // get next faulted thread ID
+int __t_waitset(struct k_waitset *set, uint64_t ns, int *id); // wait on many sources
 int __t_pause(int thread);							// pause thread execution
 int __t_resume(int thread);							// resume a paused thread
 int __t_getstate(int thread, struct t_info *info);	// examine a paused thread
 int __t_setstate(int thread, struct t_info *info);	// modify a paused thread
 int __t_sysret(uint32_t regs[6]);                   // switch to user mode
+int __t_setgate(void (*entry)(void));               // set syscall gate entry
+int __t_settls(int thread, void *base);             // set TLS segment base
+void *__t_gettls(int thread);                       // get TLS segment base
+int __t_setsched(int thread, int prio, int flags);  // set scheduling parameters
+int __t_setdl(int thread, struct t_dl *dl);         // set deadline reservation
+int __t_getdl(int thread, struct t_dl *dl);         // get deadline reservation
+int __t_getusage(int thread, struct t_usage *usage); // get resource usage
+int __t_sleep(uint64_t ns);                         // sleep for a duration
+int __t_sleep_until(uint64_t ns);                   // sleep until a time
+uint64_t __t_gettime(void);                         // nanoseconds since boot
 
 #define REG_EAX 0
 #define REG_EBX 1
@@ -48,8 +69,28 @@ int __t_sysret(uint32_t regs[6]);                   // switch to user mode
 #define REG_EDI 4
 #define REG_ESI 5
 
+int __futex_wait(volatile uint32_t *addr, uint32_t value); // wait on address
+int __futex_wake(volatile uint32_t *addr, int count);      // wake waiters
+
 int __irq_wait(int irq);							// wait for an IRQ to fire
+int __irq_wait_timeout(int irq, uint64_t ns);       // ...or give up (-1)
 int __irq_reset(int irq);							// reset an IRQ
+int __irq_mode(int irq, int flags, int threshold);  // make an IRQ count
+int __ev_mode(int event, int wake);                 // wake several waiters
+
+int  __ev_ring(struct k_evring *ring, struct k_waitset *set); // route to ring
+int  __ev_ring_wait(uint64_t ns);                   // wait for ring records
+void ev_ring_next(struct k_evring *ring, struct k_evrec *rec); // take record
+void ev_ring_ack (struct k_evring *ring, int irq);  // reset IRQ (batched)
+
+/* syscalls (from usermode through the syscall gate) ***********************/
+
+#define SYSCALL_EXIT  0 // exit(int status)
+#define SYSCALL_YIELD 1 // yield(void)
+#define SYSCALL_SLEEP 2 // sleep(uint64_t ns)
+
+int syscall_handler(int call, int arg0, int arg1, int arg2);
+int syscall_init(void);
 
 /* paging contexts **********************************************************/
 
@@ -57,10 +98,16 @@ int pctx_new(void);
 int pctx_free(int pctx);
 int t_set_pctx(int thread, int pctx);
 int t_get_pctx(int thread);
+int pctx_usage(int pctx, struct t_usage *usage);
 
 /* paging *******************************************************************/
 
 int      p_alloc    (uint32_t page, int flags);
+int      p_alloc_range(uint32_t base, uint32_t size, int flags);
+int      p_free_range(uint32_t base, uint32_t size);
+int      p_map      (const struct k_mapping *map, int count);
+int      p_unmap    (uint32_t base, uint32_t size);
+int      p_protect  (uint32_t base, uint32_t size, int flags);
 int      p_set_frame(uint32_t page, uint64_t frame);
 int      p_set_flags(uint32_t page, int flags);
 uint64_t p_get_frame(uint32_t page);
@@ -1,12 +1,72 @@
 #include <stdint.h>
 #include <stdarg.h>
 #include "monitor.h"
+#include "sync.h"
 #include "log.h"
+#include "out.h"
 
 /* logging interface ********************************************************/
 
 static int _setup = 0;
 
+// keeps lines from threads on different processors from interleaving
+static struct mutex _log_lock = MUTEX_INIT;
+
+/* serial mirror ************************************************************/
+
+/*
+ * ERROR and INIT lines are also written to COM1 (already set up by the
+ * kernel's debug output), so that a headless boot can be checked from the
+ * serial log by test/run.sh.
+ */
+
+static int _serial = 0; // mirror the current line
+
+extern uint8_t inb(uint16_t port);
+
+static void serial_putc(char c) {
+
+	if (c == '\n') serial_putc('\r');
+
+	while (!(inb(0x3FD) & 0x20));
+	outb(0x3F8, c);
+}
+
+static void serial_printu(unsigned int x, unsigned int base) {
+	char buffer[11];
+	int i = 0;
+
+	do {
+		buffer[i++] = "0123456789ABCDEF"[x % base];
+		x /= base;
+	} while (x);
+
+	while (i) serial_putc(buffer[--i]);
+}
+
+static void logc(char c) {
+	printc(c);
+	if (_serial) serial_putc(c);
+}
+
+static void logs(const char *string) {
+	prints(string);
+	if (_serial) while (*string) serial_putc(*string++);
+}
+
+static void logd(int x) {
+	printd(x);
+	if (_serial) {
+		if (x < 0) serial_putc('-');
+		serial_printu(x < 0 ? -(unsigned int) x : (unsigned int) x, 10);
+	}
+}
+
+static void logx(unsigned int x) {
+	printx(x);
+	if (_serial) serial_printu(x, 16);
+}
+
 void __init_log(void) {
 	clear();
 	_setup = 1;
@@ -17,6 +77,7 @@ void lograw(const char *fmt, ...) {
 	
 	if (!_setup) return;
 
+	mutex_lock(&_log_lock);
 	setcolor(L_BROWN);
 
 	va_start(ap, fmt);
@@ -41,6 +102,7 @@ void lograw(const char *fmt, ...) {
 	printc('\n');
 
 	va_end(ap);
+	mutex_unlock(&_log_lock);
 }
 
 void __log(int level, const char *func, int line, const char *fmt, ...) {
@@ -52,12 +114,15 @@ void __log(int level, const char *func, int line, const char *fmt, ...) {
 		return;
 	}
 
+	mutex_lock(&_log_lock);
+	_serial = (level <= INIT);
+
 	if (level != INIT) {
 		setcolor(L_GREY);
-		prints(func);
-		prints(" ");
-		printd(line);
-		prints(":\t");
+		logs(func);
+		logs(" ");
+		logd(line);
+		logs(":\t");
 	}
 
 	switch (level) {
@@ -74,21 +139,23 @@ void __log(int level, const char *func, int line, const char *fmt, ...) {
 			i++;
 			switch (fmt[i]) {
 			case '\0': break;
-			case '%': printc('%'); break;
-			case 'd': printd(va_arg(ap, int)); break;
-			case 'x': printx(va_arg(ap, unsigned int)); break;
+			case '%': logc('%'); break;
+			case 'd': logd(va_arg(ap, int)); break;
+			case 'x': logx(va_arg(ap, unsigned int)); break;
 			case 'p': printp(va_arg(ap, uint32_t)); break;
-			case 's': prints(va_arg(ap, const char*)); break;
-			case 'c': printc(va_arg(ap, int)); break;
+			case 's': logs(va_arg(ap, const char*)); break;
+			case 'c': logc(va_arg(ap, int)); break;
 			}
 		}
 		else {
-			printc(fmt[i]);
+			logc(fmt[i]);
 		}
 	}
 
 	va_end(ap);
 
-	prints("\n");
+	logs("\n");
 	setcolor(L_GREY);
+	_serial = 0;
+	mutex_unlock(&_log_lock);
 }
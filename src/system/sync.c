@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2012 Nick Johnson <nickbjohnson4224 at gmail.com>
+ * 
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "kernel.h"
+#include "sync.h"
+
+/*****************************************************************************
+ * mutex_lock
+ *
+ * Acquire a mutex, blocking in the kernel while it is held by another 
+ * thread. A mutex in state 2 may have waiters, so its holder must enter the
+ * kernel to wake one on release; a thread that had to wait always takes the
+ * lock in state 2 for that reason.
+ */
+
+void mutex_lock(struct mutex *m) {
+	uint32_t c;
+
+	c = __sync_val_compare_and_swap(&m->state, 0, 1);
+	if (c == 0) {
+		return;
+	}
+
+	do {
+		if (c == 2 || __sync_val_compare_and_swap(&m->state, 1, 2) != 0) {
+			__futex_wait(&m->state, 2);
+		}
+	} while ((c = __sync_val_compare_and_swap(&m->state, 0, 2)) != 0);
+}
+
+/*****************************************************************************
+ * mutex_trylock
+ *
+ * Acquire a mutex if it is free. Returns zero on success, nonzero if the
+ * mutex is held by another thread.
+ */
+
+int mutex_trylock(struct mutex *m) {
+	return (__sync_val_compare_and_swap(&m->state, 0, 1) != 0);
+}
+
+/*****************************************************************************
+ * mutex_unlock
+ *
+ * Release a mutex, waking one waiter if there may be any.
+ */
+
+void mutex_unlock(struct mutex *m) {
+	
+	if (__sync_fetch_and_sub(&m->state, 1) != 1) {
+		m->state = 0;
+		__futex_wake(&m->state, 1);
+	}
+}
+
+/*****************************************************************************
+ * cond_wait
+ *
+ * Atomically release the mutex <m> and wait for the condition variable <c>
+ * to be signalled, then reacquire <m>. As with any condition variable, 
+ * wakeups may be spurious, so the caller must recheck its predicate.
+ */
+
+void cond_wait(struct cond *c, struct mutex *m) {
+	uint32_t seq = c->seq;
+
+	mutex_unlock(m);
+
+	// the kernel refuses to block if a signal arrived since the unlock
+	__futex_wait(&c->seq, seq);
+
+	// waiters may contend with each other after a broadcast
+	while (__sync_lock_test_and_set(&m->state, 2) != 0) {
+		__futex_wait(&m->state, 2);
+	}
+}
+
+/*****************************************************************************
+ * cond_signal
+ *
+ * Wake one thread waiting on a condition variable.
+ */
+
+void cond_signal(struct cond *c) {
+	__sync_fetch_and_add(&c->seq, 1);
+	__futex_wake(&c->seq, 1);
+}
+
+/*****************************************************************************
+ * cond_broadcast
+ *
+ * Wake all threads waiting on a condition variable.
+ */
+
+void cond_broadcast(struct cond *c) {
+	__sync_fetch_and_add(&c->seq, 1);
+	__futex_wake(&c->seq, 0x7FFFFFFF);
+}
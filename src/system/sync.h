@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2012 Nick Johnson <nickbjohnson4224 at gmail.com>
+ * 
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <stdint.h>
+
+/*****************************************************************************
+ * Synchronization primitives
+ *
+ * Mutexes and condition variables for threads in the system layer, built on
+ * the kernel's wait-on-address (futex) calls. The uncontended paths are a 
+ * single atomic operation and never enter the kernel.
+ */
+
+/* mutexes ******************************************************************/
+
+struct mutex {
+	volatile uint32_t state; // 0 = unlocked, 1 = locked, 2 = locked/contended
+};
+
+#define MUTEX_INIT { 0 }
+
+void mutex_lock(struct mutex *m);
+int  mutex_trylock(struct mutex *m);
+void mutex_unlock(struct mutex *m);
+
+/* condition variables ******************************************************/
+
+struct cond {
+	volatile uint32_t seq; // incremented on every signal/broadcast
+};
+
+#define COND_INIT { 0 }
+
+void cond_wait(struct cond *c, struct mutex *m);
+void cond_signal(struct cond *c);
+void cond_broadcast(struct cond *c);
+
+#endif/*SYNC_H*/
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2012 Nick Johnson <nickbjohnson4224 at gmail.com>
+ * 
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <pinion.h>
+#include "kernel.h"
+
+/*****************************************************************************
+ * syscall_handler
+ *
+ * Handles a system call made by usermode through the syscall gate (see 
+ * "system/syscall.s"). Returns the result to be passed back in eax, or -1
+ * if the call is not recognized.
+ */
+
+int syscall_handler(int call, int arg0, int arg1, int arg2) {
+
+	switch (call) {
+	case SYSCALL_EXIT:  return __t_exit(arg0);
+	case SYSCALL_YIELD: return __t_yield();
+	case SYSCALL_SLEEP: return __t_sleep((uint32_t) arg0 | (uint64_t) arg1 << 32);
+	default:            return -1;
+	}
+}
+
+/*****************************************************************************
+ * syscall_init
+ *
+ * Registers the system layer's entry point for the syscall gate.
+ */
+
+int syscall_init(void) {
+	extern void syscall_entry(void);
+
+	return __t_setgate(syscall_entry);
+}
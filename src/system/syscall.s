@@ -0,0 +1,46 @@
+; Copyright (C) 2012 Nick Johnson <nickbjohnson4224 at gmail.com>
+; 
+; Permission to use, copy, modify, and distribute this software for any
+; purpose with or without fee is hereby granted, provided that the above
+; copyright notice and this permission notice appear in all copies.
+; 
+; THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+; WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+; MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+; ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+; WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+; ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+; OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+[bits 32]
+
+; syscall_entry - system layer entry point of the usermode syscall gate
+;
+; Usermode arrives here through "call GATE_SEL:0" with the call number in 
+; eax and arguments in ebx, ecx and edx, on its thread's system stack, with
+; the far return frame on top. The result is returned in eax; ecx and edx 
+; are clobbered. The kernel is not entered unless the handler needs it.
+
+extern syscall_handler
+
+global syscall_entry
+syscall_entry:
+	push ds
+	push es
+
+	push edx
+	push ecx
+	push ebx
+	push eax
+
+	; the kernel tells the system layer from usermode by its data segment
+	mov ax, 0x21
+	mov ds, ax
+	mov es, ax
+
+	call syscall_handler
+	add esp, 16
+
+	pop es
+	pop ds
+	retf